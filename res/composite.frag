@@ -0,0 +1,16 @@
+/*
+ * Copyright (C) 2017, Isaac Woods. All rights reserved.
+ */
+
+#version 330 core
+
+in vec2 texCoord;
+
+layout (location = 0) out vec4 fragColor;
+
+uniform sampler2D source;
+
+void main()
+{
+  fragColor = texture(source, texCoord);
+}
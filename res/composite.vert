@@ -0,0 +1,16 @@
+/*
+ * Copyright (C) 2017, Isaac Woods. All rights reserved.
+ */
+
+#version 330 core
+
+out vec2 texCoord;
+
+/*
+ * Draws a single triangle that covers the whole screen, without needing any vertex data.
+ */
+void main()
+{
+  texCoord = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+  gl_Position = vec4(texCoord * 2.0 - 1.0, 0.0, 1.0);
+}
@@ -0,0 +1,22 @@
+/*
+ * Copyright (C) 2017, Isaac Woods. All rights reserved.
+ */
+
+#version 330 core
+
+in vec2 fragTexCoord;
+in vec3 fragNormal;
+
+layout (location = 0) out vec4 fragColor;
+
+uniform sampler2D diffuse;
+
+const vec3  LIGHT_DIRECTION = normalize(vec3(-0.4, 0.6, 0.7));    // NOTE(Isaac): towards the light
+const float AMBIENT         = 0.35;
+
+void main()
+{
+  float lighting = AMBIENT + (1.0 - AMBIENT) * max(dot(normalize(fragNormal), LIGHT_DIRECTION), 0.0);
+  vec4 color = texture(diffuse, fragTexCoord);
+  fragColor = vec4(color.rgb * lighting, color.a);
+}
@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2017, Isaac Woods. All rights reserved.
+ */
+
+#version 330 core
+
+/*
+ * Features:
+ *    PACKED_VERTICES - the mesh is in `VERTEX_FORMAT_PACKED`, so the normal needs decoding. The positions have
+ *                      already been normalised by GL, and are mapped back onto the mesh's bounds with the
+ *                      mesh's dequantisation uniforms.
+ */
+
+#ifdef PACKED_VERTICES
+layout (location = 0) in vec4 position;   // NOTE(Isaac): `w` is the bitangent's handedness, which we don't need
+layout (location = 2) in vec2 normal;
+#else
+layout (location = 0) in vec3 position;
+layout (location = 2) in vec3 normal;
+#endif
+layout (location = 1) in vec2 texCoord;
+layout (location = 4) in uint transformIndex;   // NOTE(Isaac): per-instance
+
+/*
+ * Each transform is four consecutive texels, one for each column.
+ */
+uniform samplerBuffer instanceTransforms;
+
+#ifdef PACKED_VERTICES
+uniform vec3 dequantisationScale;
+uniform vec3 dequantisationOffset;
+#endif
+
+layout (std140) uniform FrameUniforms
+{
+  mat4 projection;
+};
+
+out vec2 fragTexCoord;
+out vec3 fragNormal;
+
+#ifdef PACKED_VERTICES
+vec3 DecodeOctahedral(vec2 e)
+{
+  vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+  float t = max(-n.z, 0.0);
+  n.x += (n.x >= 0.0) ? -t : t;
+  n.y += (n.y >= 0.0) ? -t : t;
+  return normalize(n);
+}
+#endif
+
+void main()
+{
+  int first = int(transformIndex) * 4;
+  mat4 model = mat4(texelFetch(instanceTransforms, first),
+                    texelFetch(instanceTransforms, first + 1),
+                    texelFetch(instanceTransforms, first + 2),
+                    texelFetch(instanceTransforms, first + 3));
+
+  /*
+   * NOTE(Isaac): this assumes the instance transforms only scale uniformly. The cooker has already undone the
+   * dequantisation's scale on packed normals, so that it cancels out here.
+   */
+#ifdef PACKED_VERTICES
+  gl_Position = projection * model * vec4(position.xyz * dequantisationScale + dequantisationOffset, 1.0);
+  fragNormal = mat3(model) * (dequantisationScale * DecodeOctahedral(normal));
+#else
+  gl_Position = projection * model * vec4(position.xyz, 1.0);
+  fragNormal = mat3(model) * normal;
+#endif
+
+  fragTexCoord = texCoord;
+}
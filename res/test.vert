@@ -1,15 +0,0 @@
-/*
- * Copyright (C) 2016, Isaac Woods. All rights reserved.
- */
-
-#version 330 core
-
-layout (location = 0) in vec2 position;
-
-uniform mat4 projection;
-
-void main()
-{
-  gl_Position = projection * vec4(position, 0.0, 1.0);
-  gl_PointSize = 3.0;
-}
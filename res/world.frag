@@ -6,9 +6,18 @@
 
 layout (location = 0) out vec4 fragColor;
 
+#ifdef CELL_COLORS
+flat in uint fragCell;
+uniform samplerBuffer cellColors;
+#else
 uniform vec4 color;
+#endif
 
 void main()
 {
+#ifdef CELL_COLORS
+  fragColor = texelFetch(cellColors, int(fragCell));
+#else
   fragColor = color;
+#endif
 }
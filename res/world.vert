@@ -0,0 +1,38 @@
+/*
+ * Copyright (C) 2016, Isaac Woods. All rights reserved.
+ */
+
+#version 330 core
+
+/*
+ * Features:
+ *    CELL_COLORS - fill each cell with its own colour from `cellColors`, rather than using a single `color`
+ */
+
+layout (location = 0) in vec2 position;
+#ifdef CELL_COLORS
+layout (location = 1) in uint cell;
+#endif
+
+layout (std140) uniform FrameUniforms
+{
+  mat4 projection;
+};
+
+#ifdef CELL_COLORS
+/*
+ * Only the vertex at the center of each cell has the right index, so we rely on it being the provoking vertex.
+ */
+flat out uint fragCell;
+#endif
+
+void main()
+{
+  gl_Position = projection * vec4(position, 0.0, 1.0);
+
+#ifdef CELL_COLORS
+  fragCell = cell;
+#else
+  gl_PointSize = 3.0;
+#endif
+}
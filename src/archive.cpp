@@ -0,0 +1,254 @@
+/*
+ * Copyright (C) 2017, Isaac Woods.
+ * See LICENCE.md
+ */
+
+#include <archive.hpp>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <algorithm>
+#include <vector>
+#include <utility>
+#include <sys/stat.h>
+#include <asset.hpp>
+#include <compression.hpp>
+
+static MappedFile g_archive = {};
+static const ArchiveEntry* g_archiveEntries = nullptr;
+static unsigned int g_numArchiveEntries = 0u;
+
+bool MountArchive(const char* path)
+{
+  UnmountArchive();
+  FileError error = MapFile(path, g_archive);
+
+  if (error != FILE_OK)
+  {
+    fprintf(stderr, "Failed to mount archive: %s (%s)\n", path, GetFileErrorString(error));
+    return false;
+  }
+
+  const uint8_t* bytes = static_cast<const uint8_t*>(g_archive.data);
+  const ArchiveHeader* header = reinterpret_cast<const ArchiveHeader*>(bytes);
+
+  if (g_archive.size < sizeof(ArchiveHeader) || header->magic != ARCHIVE_MAGIC || header->version != ARCHIVE_VERSION ||
+      header->entryOffset + static_cast<size_t>(header->numEntries) * sizeof(ArchiveEntry) > g_archive.size)
+  {
+    fprintf(stderr, "Not an archive, or it's out of date: %s\n", path);
+    UnmapFile(g_archive);
+    return false;
+  }
+
+  const ArchiveEntry* entries = reinterpret_cast<const ArchiveEntry*>(bytes + header->entryOffset);
+
+  for (unsigned int i = 0u;
+       i < header->numEntries;
+       i++)
+  {
+    if (static_cast<size_t>(entries[i].offset) + entries[i].size > g_archive.size ||
+        static_cast<size_t>(entries[i].pathOffset) + entries[i].pathLength > g_archive.size ||
+        (i > 0u && entries[i - 1u].hash >= entries[i].hash))
+    {
+      fprintf(stderr, "Archive is corrupt: %s\n", path);
+      UnmapFile(g_archive);
+      return false;
+    }
+  }
+
+  g_archiveEntries = entries;
+  g_numArchiveEntries = header->numEntries;
+  printf("Mounted archive: %s (%u files, %zu bytes)\n", path, g_numArchiveEntries, g_archive.size);
+  return true;
+}
+
+void UnmountArchive()
+{
+  UnmapFile(g_archive);
+  g_archiveEntries = nullptr;
+  g_numArchiveEntries = 0u;
+}
+
+static const ArchiveEntry* FindArchiveEntry(const char* path)
+{
+  if (!g_archiveEntries)
+  {
+    return nullptr;
+  }
+
+  std::string normalisedPath = NormalisePath(path);
+  uint64_t hash = HashPath(normalisedPath);
+  const ArchiveEntry* end = g_archiveEntries + g_numArchiveEntries;
+  const ArchiveEntry* entry = std::lower_bound(g_archiveEntries, end, hash,
+    [](const ArchiveEntry& entry, uint64_t hash)
+    {
+      return entry.hash < hash;
+    });
+
+  if (entry == end || entry->hash != hash)
+  {
+    return nullptr;
+  }
+
+  // NOTE(Isaac): the hash could collide with a file that isn't in the archive, so check it's really this one
+  const char* entryPath = static_cast<const char*>(g_archive.data) + entry->pathOffset;
+  if (entry->pathLength != normalisedPath.size() || memcmp(entryPath, normalisedPath.data(), entry->pathLength) != 0)
+  {
+    return nullptr;
+  }
+
+  return entry;
+}
+
+FileView::FileView()
+  :data(nullptr)
+  ,size(0u)
+  ,mapping{nullptr, 0u}
+  ,buffer(nullptr)
+{
+}
+
+FileView::FileView(FileView&& other)
+  :data(other.data)
+  ,size(other.size)
+  ,mapping(other.mapping)
+  ,buffer(other.buffer)
+{
+  other.data = nullptr;
+  other.size = 0u;
+  other.mapping = MappedFile{nullptr, 0u};
+  other.buffer = nullptr;
+}
+
+FileView& FileView::operator=(FileView&& other)
+{
+  if (this != &other)
+  {
+    CloseFile(*this);
+    std::swap(data, other.data);
+    std::swap(size, other.size);
+    std::swap(mapping, other.mapping);
+    std::swap(buffer, other.buffer);
+  }
+
+  return *this;
+}
+
+FileView::~FileView()
+{
+  CloseFile(*this);
+}
+
+/*
+ * Fills in a view of a file in the archive, decompressing it if it needs to be.
+ */
+static FileError OpenArchivedFile(const ArchiveEntry* entry, FileView& view)
+{
+  const uint8_t* contents = static_cast<const uint8_t*>(g_archive.data) + entry->offset;
+
+  if (!(entry->flags & ARCHIVE_ENTRY_COMPRESSED))
+  {
+    view.data = contents;
+    view.size = entry->size;
+    return FILE_OK;
+  }
+
+  view.buffer = static_cast<uint8_t*>(malloc(entry->originalSize));
+
+  if (!view.buffer)
+  {
+    return FILE_OUT_OF_MEMORY;
+  }
+
+  if (!DecompressBlock(contents, entry->size, view.buffer, entry->originalSize))
+  {
+    free(view.buffer);
+    view.buffer = nullptr;
+    return FILE_CORRUPT;
+  }
+
+  view.data = view.buffer;
+  view.size = entry->originalSize;
+  return FILE_OK;
+}
+
+static FileError OpenMappedFile(const char* path, FileView& view)
+{
+  FileError error = MapFile(path, view.mapping);
+
+  if (error == FILE_OK)
+  {
+    view.data = view.mapping.data;
+    view.size = view.mapping.size;
+  }
+
+  return error;
+}
+
+FileError OpenFile(const char* path, FileView& view)
+{
+  CloseFile(view);
+  const ArchiveEntry* entry = FindArchiveEntry(path);
+
+  if (entry)
+  {
+    return OpenArchivedFile(entry, view);
+  }
+
+  return OpenMappedFile(path, view);
+}
+
+void OpenFiles(const char* const* paths, unsigned int count, FileView* views, FileError* errors)
+{
+  std::vector<FileRead> reads;
+  std::vector<unsigned int> readIndices;
+
+  for (unsigned int i = 0u;
+       i < count;
+       i++)
+  {
+    CloseFile(views[i]);
+    const ArchiveEntry* entry = FindArchiveEntry(paths[i]);
+
+    if (entry)
+    {
+      errors[i] = OpenArchivedFile(entry, views[i]);
+      continue;
+    }
+
+    struct stat info;
+    if (stat(paths[i], &info) == 0 && info.st_size < static_cast<off_t>(SMALL_FILE_SIZE))
+    {
+      reads.push_back(FileRead{paths[i], nullptr, 0u, FILE_OK});
+      readIndices.push_back(i);
+      continue;
+    }
+
+    // NOTE(Isaac): this also catches files that don't exist, so we get the right error for them
+    errors[i] = OpenMappedFile(paths[i], views[i]);
+  }
+
+  ReadFiles(reads.data(), static_cast<unsigned int>(reads.size()));
+
+  for (unsigned int i = 0u;
+       i < reads.size();
+       i++)
+  {
+    FileView& view = views[readIndices[i]];
+    errors[readIndices[i]] = reads[i].error;
+    view.buffer = reads[i].data;
+    view.data = reads[i].data;
+    view.size = reads[i].size;
+  }
+}
+
+void CloseFile(FileView& view)
+{
+  UnmapFile(view.mapping);
+  free(view.buffer);
+
+  view.data = nullptr;
+  view.size = 0u;
+  view.buffer = nullptr;
+}
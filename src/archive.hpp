@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2017, Isaac Woods.
+ * See LICENCE.md
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <platform.hpp>
+
+/*
+ * Files are read through here, rather than straight from disk, so they can come out of an archive (see
+ * `ArchiveHeader`) if one is mounted. Anything that isn't in the archive is mapped from its loose file instead,
+ * so assets can still be loaded without packing them first.
+ *
+ * NOTE(Isaac): the archive should be mounted before anything is loaded, and not unmounted until everything has
+ * finished loading, because views of uncompressed files point straight into it. Between those, it's only read
+ * from, so files can be opened from any thread.
+ */
+struct FileView
+{
+  FileView();
+  FileView(FileView&& other);
+  FileView& operator=(FileView&& other);
+  FileView(const FileView&) = delete;
+  FileView& operator=(const FileView&) = delete;
+  ~FileView();
+
+  const void* data;
+  size_t      size;
+
+  // NOTE(Isaac): at most one of these is used, depending on where the data came from. Both are owned by the view
+  MappedFile  mapping;    // NOTE(Isaac): for loose files that have been mapped
+  uint8_t*    buffer;     // NOTE(Isaac): for compressed files and small loose files, which are read into this
+};
+
+bool MountArchive(const char* path);
+void UnmountArchive();
+
+/*
+ * Files in the archive are looked up by their normalised path (see `NormalisePath`). Uncompressed ones are
+ * handed back as a view into the archive's mapping, and loose files are mapped, so opening them doesn't copy
+ * anything. Views close themselves when they're destroyed, but can be closed early with `CloseFile`.
+ */
+FileError OpenFile(const char* path, FileView& view);
+void CloseFile(FileView& view);
+
+/*
+ * Opens a batch of files at once, and returns once they're all open. Loose files smaller than `SMALL_FILE_SIZE`
+ * are read with one batch of reads (see `ReadFiles`) rather than mapped, because mapping a small file costs
+ * more than copying it. Files in the archive don't need reading at all, so when one is mounted, this is no
+ * different to opening each file in turn.
+ */
+#define SMALL_FILE_SIZE (64u * 1024u)
+
+void OpenFiles(const char* const* paths, unsigned int count, FileView* views, FileError* errors);
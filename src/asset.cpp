@@ -4,97 +4,198 @@
  */
 
 #include <asset.hpp>
-#include <iostream>
-#include <assimp/Importer.hpp>
-#include <assimp/scene.h>
-#include <assimp/postprocess.h>
-#include <platform.hpp>
+#include <cstddef>
+#include <new>
+#include <utility>
 #include <maths.hpp>
 
+MeshData::MeshData()
+  :numVertices(0u)
+  ,vertices(nullptr)
+  ,numIndices(0u)
+  ,indices(nullptr)
+  ,submeshes()
+  ,storage(nullptr)
+{
+}
+
 MeshData::MeshData(unsigned int numVertices, unsigned int numIndices)
   :numVertices(numVertices)
+  ,vertices(nullptr)
   ,numIndices(numIndices)
+  ,indices(nullptr)
+  ,submeshes()
+  ,storage(nullptr)
 {
-  vertices = new Vertex[numVertices];
-  indices = new unsigned int[numIndices];
+  // NOTE(Isaac): `Vertex` is a multiple of 4 bytes, so the indices are always aligned properly after it
+  storage = new uint8_t[numVertices * sizeof(Vertex) + numIndices * sizeof(unsigned int)];
+  vertices = reinterpret_cast<Vertex*>(storage);
+  indices = reinterpret_cast<unsigned int*>(storage + numVertices * sizeof(Vertex));
+
+  for (unsigned int i = 0u;
+       i < numVertices;
+       i++)
+  {
+    new (&vertices[i]) Vertex();
+  }
 }
 
-MeshData::~MeshData()
+MeshData::MeshData(MeshData&& other) noexcept
+  :numVertices(other.numVertices)
+  ,vertices(other.vertices)
+  ,numIndices(other.numIndices)
+  ,indices(other.indices)
+  ,submeshes(std::move(other.submeshes))
+  ,storage(other.storage)
 {
-  delete[] vertices;
-  delete[] indices;
+  other.numVertices = 0u;
+  other.vertices = nullptr;
+  other.numIndices = 0u;
+  other.indices = nullptr;
+  other.storage = nullptr;
 }
 
-MeshData ParseMeshData(const std::string& path, bool convertToRightHanded)
+MeshData& MeshData::operator=(MeshData&& other) noexcept
 {
-  Assimp::Importer importer;
+  if (this != &other)
+  {
+    delete[] storage;
 
-  const aiScene* scene = importer.ReadFile(path,  aiProcess_GenSmoothNormals      |
-                                                  aiProcess_FlipUVs               |
-                                                  aiProcess_CalcTangentSpace      |
-                                                  aiProcess_Triangulate           |
-                                                  aiProcess_JoinIdenticalVertices |
-                                                  aiProcess_SortByPType);
+    numVertices = other.numVertices;
+    vertices = other.vertices;
+    numIndices = other.numIndices;
+    indices = other.indices;
+    submeshes = std::move(other.submeshes);
+    storage = other.storage;
 
-  if (!scene)
-  {
-    std::cerr << "Failed to load scene from path: " << path << std::endl;
-    exit(1);
+    other.numVertices = 0u;
+    other.vertices = nullptr;
+    other.numIndices = 0u;
+    other.indices = nullptr;
+    other.storage = nullptr;
   }
 
-  assert(scene->HasMeshes());
-  assert(scene->mNumMeshes == 1u);
-  aiMesh* mesh = scene->mMeshes[0u];
+  return *this;
+}
 
-  assert(mesh->HasNormals());
-  assert(mesh->HasTangentsAndBitangents());
-  assert(mesh->HasTextureCoords(0u));
+MeshData::~MeshData()
+{
+  // NOTE(Isaac): `Vertex` doesn't need destructing, so we can just free the memory
+  delete[] storage;
+}
 
-  // We know that there are 3 indices per face, because the mesh has been triangulated
-  MeshData meshData(mesh->mNumVertices, mesh->mNumFaces * 3u);
+const VertexFormat& GetVertexFormat(VertexFormatType type)
+{
+  static const VertexFormat FORMATS[NUM_VERTEX_FORMATS] =
+    {
+      // VERTEX_FORMAT_FLOAT
+      {
+        sizeof(Vertex),
+        {
+          { ATTRIBUTE_FLOAT, 3u, offsetof(Vertex, position) },
+          { ATTRIBUTE_FLOAT, 2u, offsetof(Vertex, texCoord) },
+          { ATTRIBUTE_FLOAT, 3u, offsetof(Vertex, normal)   },
+          { ATTRIBUTE_FLOAT, 4u, offsetof(Vertex, tangent)  },
+        }
+      },
 
-  for (unsigned int i = 0u;
-       i < meshData.numVertices;
-       i++)
+      // VERTEX_FORMAT_PACKED
+      {
+        20u,
+        {
+          { ATTRIBUTE_UNORM16,  4u, 0u  },
+          { ATTRIBUTE_HALF,     2u, 8u  },
+          { ATTRIBUTE_SNORM16,  2u, 12u },
+          { ATTRIBUTE_SNORM16,  2u, 16u },
+        }
+      },
+    };
+
+  return FORMATS[type];
+}
+
+unsigned int GetTextureRowHeight(TextureFormatType format)
+{
+  return (format == TEXTURE_FORMAT_RGBA8) ? 1u : 4u;
+}
+
+unsigned int GetTextureRowSize(TextureFormatType format, unsigned int width)
+{
+  switch (format)
   {
-    meshData.vertices[i] = Vertex(Vec<3u>(mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z),
-                                  Vec<2u>(mesh->mTextureCoords[0u][i].x, mesh->mTextureCoords[0u][i].y)/*,
-                                  Vec<3u>(mesh->mNormals[i].x, mesh->mNormals[i].y, mesh->mNormals[i].z),
-                                  Vec<3u>(mesh->mTangents[i].x, mesh->mTangents[i].y, mesh->mTangents[i].z)*/);
+    case TEXTURE_FORMAT_RGBA8:  return width * 4u;
+    case TEXTURE_FORMAT_BC1:    return ((width + 3u) / 4u) * 8u;
+    case TEXTURE_FORMAT_BC3:    return ((width + 3u) / 4u) * 16u;
+    default:                    return 0u;
   }
+}
+
+unsigned int GetTextureLevelSize(TextureFormatType format, unsigned int width, unsigned int height)
+{
+  unsigned int rowHeight = GetTextureRowHeight(format);
+  return GetTextureRowSize(format, width) * ((height + rowHeight - 1u) / rowHeight);
+}
+
+std::string NormalisePath(const std::string& path)
+{
+  std::vector<std::string> components;
+  size_t start = 0u;
 
-  /*
-   * Some tools use a left-handed coordinate system (i.e. Blender), and we can't read this using Assimp (even
-   * tho it's in the Collada file), so we can flip it into RH here.
-   */
-  if (convertToRightHanded)
+  while (start <= path.size())
   {
-    static const Mat<4u> TO_RH_MATRIX = Rotation<4u>(Quaternion(Vec<3u>(1.0f, 0.0f, 0.0f), RADIANS(-90.0f)));
-/*    Print("TO_RH_MATRIX: %m4\n", TO_RH_MATRIX);
-    Print("Test vec: %v4    Transformed vec: %v4\n", Vec<4u>(Vec<3u>(5.0f, 2.0f, 3.0f), 1.0f),
-                                                     TO_RH_MATRIX * Vec<4u>(Vec<3u>(5.0f, 2.0f, 3.0f), 1.0f));*/
-
-    for (unsigned int i = 0u;
-         i < meshData.numVertices;
-         i++)
+    size_t end = path.find('/', start);
+
+    if (end == std::string::npos)
+    {
+      end = path.size();
+    }
+
+    std::string component = path.substr(start, end - start);
+
+    if (component == "..")
     {
-      Vec<4u> transformedPos = TO_RH_MATRIX * Vec<4u>(meshData.vertices[i].position, 0.0f);
-//      Print("%v4 -> %v4\n", meshData.vertices[i].position, transformedPos);
-      meshData.vertices[i].position = Vec<3u>(transformedPos[0u], transformedPos[1u], transformedPos[2u]);
+      if (!components.empty() && components.back() != "..")
+      {
+        components.pop_back();
+      }
+      else
+      {
+        components.push_back(component);
+      }
     }
+    else if (!component.empty() && component != ".")
+    {
+      components.push_back(component);
+    }
+
+    start = end + 1u;
   }
 
+  std::string result = (!path.empty() && path[0u] == '/') ? "/" : "";
+
   for (unsigned int i = 0u;
-       i < mesh->mNumFaces;
+       i < components.size();
        i++)
   {
-    const aiFace& face = mesh->mFaces[i];
-    assert(face.mNumIndices == 3u);
+    result += (i == 0u) ? components[i] : "/" + components[i];
+  }
+
+  return result;
+}
+
+/*
+ * 64-bit FNV-1a. Archives refuse to pack two paths with the same hash, so collisions are caught when the
+ * archive is built rather than when something loads the wrong file.
+ */
+uint64_t HashPath(const std::string& normalisedPath)
+{
+  uint64_t hash = 0xcbf29ce484222325ull;
 
-    meshData.indices[i*3u+0u] = face.mIndices[0u];
-    meshData.indices[i*3u+1u] = face.mIndices[1u];
-    meshData.indices[i*3u+2u] = face.mIndices[2u];
+  for (char c : normalisedPath)
+  {
+    hash ^= static_cast<uint8_t>(c);
+    hash *= 0x100000001b3ull;
   }
 
-  return meshData;
+  return hash;
 }
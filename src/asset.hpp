@@ -6,17 +6,308 @@
 #pragma once
 
 #include <string>
+#include <vector>
+#include <cstdint>
+#include <utility>
 #include <maths.hpp>
 
+/*
+ * A part of a mesh that's drawn with a single material. Every submesh of a mesh shares its vertex and index
+ * buffers, and is just a range of its indices (which index into the whole vertex buffer).
+ */
+struct Submesh
+{
+  uint32_t  firstIndex;
+  uint32_t  numIndices;
+  uint32_t  materialIndex;    // NOTE(Isaac): as numbered by the file the mesh was imported from
+};
+
+/*
+ * The vertices and indices live in one allocation, which is owned by the `MeshData`. It can be moved but not
+ * copied, so the (potentially big) buffers are never duplicated by accident.
+ */
 struct MeshData
 {
+  MeshData();
   MeshData(unsigned int numVertices, unsigned int numIndices);
+  MeshData(MeshData&& other) noexcept;
+  MeshData& operator=(MeshData&& other) noexcept;
+  MeshData(const MeshData&) = delete;
+  MeshData& operator=(const MeshData&) = delete;
   ~MeshData();
 
-  unsigned int  numVertices;
-  Vertex*       vertices;
-  unsigned int  numIndices;
-  unsigned int* indices;
+  unsigned int          numVertices;
+  Vertex*               vertices;     // NOTE(Isaac): points into `storage`
+  unsigned int          numIndices;
+  unsigned int*         indices;      // NOTE(Isaac): points into `storage`, straight after the vertices
+  std::vector<Submesh>  submeshes;
+
+private:
+  uint8_t*              storage;
+};
+
+/*
+ * Vertex formats describe how the attributes of a vertex are laid out in a vertex buffer, so that the cooker
+ * knows how to pack them and the renderer knows how to point GL at them. They're written without any GL types,
+ * so the cooker doesn't need GL to use them.
+ */
+enum VertexFormatType : uint32_t
+{
+  VERTEX_FORMAT_FLOAT,    // NOTE(Isaac): everything as 32-bit floats, exactly like `Vertex` (48 bytes)
+  /*
+   * 20 bytes per vertex:
+   *    position  - 16-bit unorms, which are mapped back onto the mesh's bounds by its dequantisation.
+   *                `w` holds the handedness of the bitangent (0 for -1, 1 for +1)
+   *    texCoord  - 16-bit half floats
+   *    normal    - 16-bit snorms, octahedral-encoded
+   *    tangent   - 16-bit snorms, octahedral-encoded
+   */
+  VERTEX_FORMAT_PACKED,
+  NUM_VERTEX_FORMATS
+};
+
+enum VertexAttributeType : uint32_t
+{
+  ATTRIBUTE_FLOAT,
+  ATTRIBUTE_HALF,
+  ATTRIBUTE_UNORM16,
+  ATTRIBUTE_SNORM16,
+};
+
+enum VertexAttributeLocation : uint32_t
+{
+  ATTRIBUTE_POSITION  = 0u,
+  ATTRIBUTE_TEXCOORD  = 1u,
+  ATTRIBUTE_NORMAL    = 2u,
+  ATTRIBUTE_TANGENT   = 3u,
+  NUM_VERTEX_ATTRIBUTES
+};
+
+struct VertexAttribute
+{
+  VertexAttributeType type;
+  unsigned int        components;
+  unsigned int        offset;     // NOTE(Isaac): in bytes, from the start of the vertex
+};
+
+struct VertexFormat
+{
+  unsigned int    stride;
+  VertexAttribute attributes[NUM_VERTEX_ATTRIBUTES];    // NOTE(Isaac): indexed by `VertexAttributeLocation`
+};
+
+const VertexFormat& GetVertexFormat(VertexFormatType type);
+
+/*
+ * Meshes are cooked offline (by `tools/cooker`) from whatever format they were authored in, into a file that
+ * can be mapped straight into memory and uploaded to the GPU as-is. The file is a `CookedMeshHeader`, followed
+ * by `numVertices` vertices in `vertexFormat`, followed by `numIndices` indices of `indexSize` bytes each,
+ * followed by `numSubmeshes` `Submesh`s. Indices are 16-bit if the mesh has few enough vertices, and 32-bit
+ * otherwise.
+ *
+ * Positions are transformed back into the mesh's space by `position * dequantisationScale +
+ * dequantisationOffset`. For `VERTEX_FORMAT_FLOAT` meshes, that's the identity.
+ *
+ * NOTE(Isaac): bump the version whenever the layout of the file (or of a vertex format) changes, so stale
+ * meshes are caught when they're loaded rather than drawn as garbage.
+ */
+#define COOKED_MESH_MAGIC   0x4853454Du   // NOTE(Isaac): "MESH"
+#define COOKED_MESH_VERSION 3u
+
+struct CookedMeshHeader
+{
+  uint32_t          magic;
+  uint32_t          version;
+  VertexFormatType  vertexFormat;
+  uint32_t          vertexStride;     // NOTE(Isaac): so we can tell if the format has changed under us
+  uint32_t          indexSize;        // NOTE(Isaac): in bytes; either 2 or 4
+  uint32_t          numVertices;
+  uint32_t          numIndices;
+  uint32_t          numSubmeshes;
+  uint32_t          vertexOffset;     // NOTE(Isaac): all offsets are in bytes, from the start of the file
+  uint32_t          indexOffset;
+  uint32_t          submeshOffset;
+  float             boundingRadius;
+  float             dequantisationScale[3u];
+  float             dequantisationOffset[3u];
+};
+
+/*
+ * Textures are cooked into a `CookedTextureHeader`, followed by `numMips` `CookedMip`s (largest first),
+ * followed by the texels of each level. Every level is filtered by the cooker, so the game can upload them
+ * straight out of the file without generating any mips itself.
+ *
+ * Block-compressed formats are stored as rows of 4x4 blocks, so levels smaller than a block still take up a
+ * whole one.
+ */
+#define COOKED_TEXTURE_MAGIC    0x52584554u   // NOTE(Isaac): "TEXR"
+#define COOKED_TEXTURE_VERSION  1u
+#define MAX_TEXTURE_MIPS        16u           // NOTE(Isaac): enough for a 32768x32768 texture
+
+enum TextureFormatType : uint32_t
+{
+  TEXTURE_FORMAT_RGBA8,   // NOTE(Isaac): 4 bytes per texel
+  TEXTURE_FORMAT_BC1,     // NOTE(Isaac): 8 bytes per 4x4 block, with no alpha (S3TC's DXT1)
+  TEXTURE_FORMAT_BC3,     // NOTE(Isaac): 16 bytes per 4x4 block (S3TC's DXT5)
+  NUM_TEXTURE_FORMATS
+};
+
+enum CookedTextureFlags : uint32_t
+{
+  TEXTURE_FLAG_SRGB = (1u << 0u),   // NOTE(Isaac): colours are sRGB-encoded, and were filtered in linear space
+};
+
+struct CookedMip
+{
+  uint32_t  width;
+  uint32_t  height;
+  uint32_t  offset;     // NOTE(Isaac): in bytes, from the start of the file
+  uint32_t  size;       // NOTE(Isaac): in bytes
+};
+
+struct CookedTextureHeader
+{
+  uint32_t          magic;
+  uint32_t          version;
+  TextureFormatType format;
+  uint32_t          flags;
+  uint32_t          width;
+  uint32_t          height;
+  uint32_t          numMips;
+  uint32_t          mipOffset;
 };
 
-MeshData ParseMeshData(const std::string& path, bool convertToRightHanded=false);
+/*
+ * Textures are uploaded a row at a time, where a row is either one row of texels or, for block-compressed
+ * formats, one row of blocks.
+ */
+unsigned int GetTextureRowHeight(TextureFormatType format);
+unsigned int GetTextureRowSize(TextureFormatType format, unsigned int width);    // NOTE(Isaac): in bytes
+unsigned int GetTextureLevelSize(TextureFormatType format, unsigned int width, unsigned int height);
+
+/*
+ * Assets that are shared between lots of things (meshes and textures, at the moment) are owned by an
+ * `AssetRegistry`, which hands out `AssetHandle`s to them. Each handle holds a reference, and the asset is
+ * unloaded as soon as the last one goes away, so they're only ever loaded once and never outlive their users.
+ *
+ * NOTE(Isaac): the reference counts aren't atomic, so handles should only be copied and destroyed on the main
+ * thread (which is the only one that can unload things anyway).
+ */
+struct Mesh;
+struct Texture;
+struct AssetRegistry;
+
+template<typename T>
+struct AssetSlot
+{
+  T*              asset;
+  std::string     path;       // NOTE(Isaac): what it's registered under
+  unsigned int    refCount;
+  AssetRegistry*  registry;
+};
+
+void ReleaseAsset(AssetSlot<Mesh>* slot);
+void ReleaseAsset(AssetSlot<Texture>* slot);
+
+template<typename T>
+struct AssetHandle
+{
+  AssetHandle()
+    :slot(nullptr)
+  {
+  }
+
+  explicit AssetHandle(AssetSlot<T>* slot)
+    :slot(slot)
+  {
+    slot->refCount++;
+  }
+
+  AssetHandle(const AssetHandle<T>& other)
+    :slot(other.slot)
+  {
+    if (slot)
+    {
+      slot->refCount++;
+    }
+  }
+
+  AssetHandle(AssetHandle<T>&& other)
+    :slot(other.slot)
+  {
+    other.slot = nullptr;
+  }
+
+  AssetHandle<T>& operator=(AssetHandle<T> other)
+  {
+    std::swap(slot, other.slot);
+    return *this;
+  }
+
+  ~AssetHandle()
+  {
+    if (slot && --(slot->refCount) == 0u)
+    {
+      ReleaseAsset(slot);
+    }
+  }
+
+  T* Get() const                                  { return slot ? slot->asset : nullptr; }
+  T* operator->() const                           { return slot->asset; }
+  explicit operator bool() const                  { return slot != nullptr; }
+  bool operator==(const AssetHandle<T>& b) const  { return slot == b.slot; }
+  bool operator!=(const AssetHandle<T>& b) const  { return slot != b.slot; }
+
+private:
+  AssetSlot<T>* slot;
+};
+
+typedef AssetHandle<Mesh>     MeshHandle;
+typedef AssetHandle<Texture>  TextureHandle;
+
+/*
+ * Archives pack lots of files into one, so they can all be loaded with a single mapping. The file is an
+ * `ArchiveHeader`, followed by `numEntries` `ArchiveEntry`s sorted by `hash` (so they can be binary searched),
+ * followed by each file's normalised path (see `NormalisePath`), followed by the contents of each file. Files are
+ * found by the hash of their path, which is then checked against the stored one, so a path that happens to
+ * have the same hash isn't mistaken for one in the archive. Each file can optionally be compressed (see
+ * compression.hpp).
+ *
+ * NOTE(Isaac): each file starts on a multiple of `ARCHIVE_ALIGNMENT`, so the headers of uncompressed assets can
+ * be read straight out of the mapping.
+ */
+#define ARCHIVE_MAGIC       0x4B434150u   // NOTE(Isaac): "PACK"
+#define ARCHIVE_VERSION     2u
+#define ARCHIVE_ALIGNMENT   16u
+
+enum ArchiveEntryFlags : uint32_t
+{
+  ARCHIVE_ENTRY_COMPRESSED = (1u << 0u),
+};
+
+struct ArchiveHeader
+{
+  uint32_t  magic;
+  uint32_t  version;
+  uint32_t  numEntries;
+  uint32_t  entryOffset;    // NOTE(Isaac): in bytes, from the start of the file
+};
+
+struct ArchiveEntry
+{
+  uint64_t  hash;
+  uint32_t  offset;         // NOTE(Isaac): in bytes, from the start of the file
+  uint32_t  size;           // NOTE(Isaac): as stored in the archive
+  uint32_t  originalSize;   // NOTE(Isaac): after it's been decompressed
+  uint32_t  flags;
+  uint32_t  pathOffset;     // NOTE(Isaac): in bytes, from the start of the file. The path isn't null-terminated
+  uint32_t  pathLength;
+};
+
+/*
+ * Gets rid of `.` components, `..` components that can be resolved, and repeated slashes, so different ways of
+ * writing the same path come out the same (e.g. `./res/cube.mesh` and `res//cube.mesh`). Symlinks aren't
+ * followed, so it works for files that only exist in an archive.
+ */
+std::string NormalisePath(const std::string& path);
+uint64_t HashPath(const std::string& normalisedPath);
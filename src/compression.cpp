@@ -0,0 +1,219 @@
+/*
+ * Copyright (C) 2017, Isaac Woods.
+ * See LICENCE.md
+ */
+
+#include <compression.hpp>
+#include <cstring>
+#include <algorithm>
+#include <vector>
+
+#define MIN_MATCH       4u
+#define MAX_OFFSET      65535u
+/*
+ * The format needs the last match to start at least 12 bytes before the end of the block, and the last 5 bytes
+ * to be literals, so decoders can copy in big chunks without running off the end.
+ */
+#define MATCH_LIMIT     12u
+#define LAST_LITERALS   5u
+#define HASH_BITS       16u
+
+static uint32_t Read32(const uint8_t* bytes)
+{
+  uint32_t value;
+  memcpy(&value, bytes, sizeof(uint32_t));
+  return value;
+}
+
+static uint32_t HashSequence(uint32_t sequence)
+{
+  return (sequence * 2654435761u) >> (32u - HASH_BITS);
+}
+
+static uint8_t* WriteLength(uint8_t* out, size_t length)
+{
+  while (length >= 255u)
+  {
+    *out++ = 255u;
+    length -= 255u;
+  }
+
+  *out++ = static_cast<uint8_t>(length);
+  return out;
+}
+
+/*
+ * Writes `numLiterals` literals, followed by a match (unless `matchLength` is 0, which is only allowed for the
+ * last sequence).
+ */
+static uint8_t* WriteSequence(uint8_t* out, const uint8_t* literals, size_t numLiterals, size_t offset,
+                              size_t matchLength)
+{
+  uint8_t* token = out++;
+  *token = static_cast<uint8_t>(std::min<size_t>(numLiterals, 15u) << 4u);
+
+  if (numLiterals >= 15u)
+  {
+    out = WriteLength(out, numLiterals - 15u);
+  }
+
+  memcpy(out, literals, numLiterals);
+  out += numLiterals;
+
+  if (matchLength > 0u)
+  {
+    *out++ = offset & 0xFFu;
+    *out++ = (offset >> 8u) & 0xFFu;
+
+    size_t length = matchLength - MIN_MATCH;
+    *token |= static_cast<uint8_t>(std::min<size_t>(length, 15u));
+
+    if (length >= 15u)
+    {
+      out = WriteLength(out, length - 15u);
+    }
+  }
+
+  return out;
+}
+
+size_t GetMaxCompressedSize(size_t size)
+{
+  // NOTE(Isaac): the worst case is all literals, which costs a byte for every 255 of them, plus the token
+  return size + size / 255u + 16u;
+}
+
+/*
+ * Greedy, with a single-entry hash table of where each 4-byte sequence was last seen. It doesn't compress as
+ * well as the real LZ4's high-compression mode, but it's only run by the cooker, so we can always swap it out.
+ */
+size_t CompressBlock(const uint8_t* src, size_t srcSize, uint8_t* dst)
+{
+  static const uint32_t EMPTY = 0xFFFFFFFFu;
+  std::vector<uint32_t> table(1u << HASH_BITS, EMPTY);
+  uint8_t* out = dst;
+  size_t anchor = 0u;     // NOTE(Isaac): the start of the literals that haven't been written yet
+  size_t position = 0u;
+
+  while (srcSize > MATCH_LIMIT && position < srcSize - MATCH_LIMIT)
+  {
+    uint32_t sequence = Read32(src + position);
+    uint32_t hash = HashSequence(sequence);
+    uint32_t candidate = table[hash];
+    table[hash] = static_cast<uint32_t>(position);
+
+    if (candidate == EMPTY || position - candidate > MAX_OFFSET || Read32(src + candidate) != sequence)
+    {
+      position++;
+      continue;
+    }
+
+    size_t matchLength = MIN_MATCH;
+
+    while (position + matchLength < srcSize - LAST_LITERALS &&
+           src[candidate + matchLength] == src[position + matchLength])
+    {
+      matchLength++;
+    }
+
+    out = WriteSequence(out, src + anchor, position - anchor, position - candidate, matchLength);
+    position += matchLength;
+    anchor = position;
+  }
+
+  out = WriteSequence(out, src + anchor, srcSize - anchor, 0u, 0u);
+  return static_cast<size_t>(out - dst);
+}
+
+static bool ReadLength(const uint8_t* src, size_t srcSize, size_t& in, size_t& length)
+{
+  uint8_t byte;
+
+  do
+  {
+    if (in >= srcSize)
+    {
+      return false;
+    }
+
+    byte = src[in++];
+    length += byte;
+  } while (byte == 255u);
+
+  return true;
+}
+
+bool DecompressBlock(const uint8_t* src, size_t srcSize, uint8_t* dst, size_t dstSize)
+{
+  size_t in = 0u;
+  size_t out = 0u;
+
+  while (in < srcSize)
+  {
+    uint8_t token = src[in++];
+    size_t numLiterals = token >> 4u;
+
+    if (numLiterals == 15u && !ReadLength(src, srcSize, in, numLiterals))
+    {
+      return false;
+    }
+
+    if (numLiterals > srcSize - in || numLiterals > dstSize - out)
+    {
+      return false;
+    }
+
+    memcpy(dst + out, src + in, numLiterals);
+    in += numLiterals;
+    out += numLiterals;
+
+    // The last sequence doesn't have a match
+    if (in == srcSize)
+    {
+      break;
+    }
+
+    if (srcSize - in < 2u)
+    {
+      return false;
+    }
+
+    size_t offset = src[in] | (src[in + 1u] << 8u);
+    size_t matchLength = token & 0xFu;
+    in += 2u;
+
+    if (matchLength == 15u && !ReadLength(src, srcSize, in, matchLength))
+    {
+      return false;
+    }
+
+    matchLength += MIN_MATCH;
+
+    if (offset == 0u || offset > out || matchLength > dstSize - out)
+    {
+      return false;
+    }
+
+    /*
+     * NOTE(Isaac): a match can overlap the bytes it's producing (which is how runs are encoded), in which case
+     * it has to be copied a byte at a time.
+     */
+    if (offset >= matchLength)
+    {
+      memcpy(dst + out, dst + out - offset, matchLength);
+    }
+    else
+    {
+      for (size_t i = 0u;
+           i < matchLength;
+           i++)
+      {
+        dst[out + i] = dst[out - offset + i];
+      }
+    }
+
+    out += matchLength;
+  }
+
+  return (out == dstSize);
+}
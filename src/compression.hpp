@@ -0,0 +1,34 @@
+/*
+ * Copyright (C) 2017, Isaac Woods.
+ * See LICENCE.md
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * A small LZ4-style compressor, for assets that are worth shrinking on disk but need to decompress quickly.
+ * The blocks it makes are in LZ4's block format (without any framing), so they can be checked with the real
+ * thing:
+ *
+ *    token       - top 4 bits are the number of literals, bottom 4 bits are the match length (minus 4). If
+ *                  either is 15, it carries on in the bytes after it (which are added up until one isn't 255)
+ *    literals    - copied straight to the output
+ *    offset      - 16-bit, little-endian, how far back the match starts in the output
+ *
+ * The last sequence of a block is only literals.
+ */
+size_t GetMaxCompressedSize(size_t size);
+
+/*
+ * Returns the size of the compressed block, which `dst` must have room for (see `GetMaxCompressedSize`).
+ */
+size_t CompressBlock(const uint8_t* src, size_t srcSize, uint8_t* dst);
+
+/*
+ * Returns false if the block is corrupt, or doesn't decompress to exactly `dstSize` bytes. Never reads or writes
+ * outside of the given buffers, whatever is in the block.
+ */
+bool DecompressBlock(const uint8_t* src, size_t srcSize, uint8_t* dst, size_t dstSize);
@@ -4,32 +4,36 @@
  */
 
 #include <entity.hpp>
+#include <cstdio>
 #include <cstdarg>
 #include <limits>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
 #include <platform.hpp>
 
-Component::Component()
-  :parent(nullptr)
+Renderable::Renderable(MeshHandle mesh, TextureHandle texture)
+  :mesh(std::move(mesh))
+  ,texture(std::move(texture))
 {
 }
 
-Renderable::Renderable(Mesh* mesh, Texture* texture)
-  :mesh(mesh)
-  ,texture(texture)
-{
-}
-
-void Renderable::Update(float /*delta*/)
+Controllable::Controllable(Controller* controller)
+  :controller(controller)
 {
 }
 
-Controllable::Controllable(Controller* controller)
-  :controller(controller)
+Parent::Parent(Entity entity)
+  :entity(entity)
+  ,localToParent()
+  ,pass(0u)
+  ,movedPass(0u)
 {
 }
 
 // TODO: Make this stuff accessible from ImGui
-void Controllable::Update(float delta)
+static Vec<3u> GetMovement(const Controller& controller, float delta)
 {
   static const float SPEED = 0.5f;
   /*
@@ -42,8 +46,8 @@ void Controllable::Update(float delta)
   /*
    * NOTE(Isaac): The divide moves each coordinate into (0.0-1.0)
    */
-  Vec<2u> stick = Vec<2u>(static_cast<float>(controller->axes[LEFT_STICK_X]),
-                          static_cast<float>(controller->axes[LEFT_STICK_Y]))
+  Vec<2u> stick = Vec<2u>(static_cast<float>(controller.axes[LEFT_STICK_X]),
+                          static_cast<float>(controller.axes[LEFT_STICK_Y]))
                         / static_cast<float>(std::numeric_limits<int16_t>::max());;
 
   //static TermHandle lengthHandle = CreateTermHandle();
@@ -74,21 +78,582 @@ void Controllable::Update(float delta)
   if (g_keys[KEY_D])  d += Vec<3u>(SPEED * delta, 0.0f, 0.0f);
 #endif
 
-  parent->transform.position += d;
-  //static TermHandle positionTermHandle = CreateTermHandle();
-  //Print(positionTermHandle, "Controllable position: %v3\n", parent->transform.position);
+  return d;
+}
+
+
+void UpdateControllable(float delta, Entity /*entity*/, Transform& transform, const Controllable& controllable)
+{
+  transform.position += GetMovement(*(controllable.controller), delta);
+}
+
+// --- Transforms ---
+static uint32_t g_transformPass = 0u;
+
+/*
+ * Children are worked out after their parents (which might be children too), so this finds its own way up the
+ * hierarchy, rather than relying on the order they're stored in. Each child is only updated once a pass. Returns
+ * whether the child has moved in this pass.
+ */
+static bool UpdateChild(EntityManager& entities, Entity entity)
+{
+  Parent* parent = entities.GetComponent<Parent>(entity);
+
+  if (parent->pass == g_transformPass)
+  {
+    return (parent->movedPass == g_transformPass);
+  }
+
+  parent->pass = g_transformPass;
+  Chunk* chunk = entities.GetChunk(entity);
+  const Signature localChanges = MakeSignature<Transform, Parent>();
+  bool changed = (chunk->changed & localChanges).any();
+
+  if (changed)
+  {
+    parent->localToParent = CreateTransformation(*(entities.GetComponent<Transform>(entity)));
+  }
+
+  /*
+   * NOTE(Isaac): the `LocalToWorld` flags stay set until the renderer has seen them, so they can't tell us what's
+   * moved in this pass. Parents without parents of their own have moved if their chunk's `Transform`s have.
+   */
+  bool parentMoved;
+  if (entities.HasComponent<Parent>(parent->entity))
+  {
+    parentMoved = UpdateChild(entities, parent->entity);
+  }
+  else
+  {
+    Chunk* parentChunk = entities.GetChunk(parent->entity);
+    parentMoved = (parentChunk && parentChunk->changed.test(GetComponentId<Transform>()));
+  }
+
+  const LocalToWorld* parentToWorld = entities.GetComponent<LocalToWorld>(parent->entity);
+  if (parentToWorld && parentMoved)
+  {
+    changed = true;
+  }
+
+  if (changed)
+  {
+    LocalToWorld* localToWorld = entities.GetComponent<LocalToWorld>(entity);
+    localToWorld->matrix = parentToWorld ? parentToWorld->matrix * parent->localToParent : parent->localToParent;
+    chunk->changed.set(GetComponentId<LocalToWorld>());
+    parent->movedPass = g_transformPass;
+  }
+
+  return changed;
+}
+
+bool UpdateWorldTransforms(EntityManager& entities)
+{
+  const ComponentId TRANSFORM = GetComponentId<Transform>();
+  const ComponentId LOCAL_TO_WORLD = GetComponentId<LocalToWorld>();
+  const ComponentId PARENT = GetComponentId<Parent>();
+  const Signature query = MakeSignature<Transform, LocalToWorld>();
+  bool anyChanged = false;
+  bool childrenChanged = false;
+  g_transformPass++;
+
+  // Entities without parents are just a straight walk over each chunk that has changed
+  for (Archetype* archetype : entities.GetArchetypes())
+  {
+    if ((archetype->signature & query) != query)
+    {
+      continue;
+    }
+
+    if (archetype->signature.test(PARENT))
+    {
+      for (const Chunk& chunk : archetype->chunks)
+      {
+        childrenChanged |= (chunk.changed.test(TRANSFORM) || chunk.changed.test(PARENT));
+      }
+
+      continue;
+    }
+
+    for (Chunk& chunk : archetype->chunks)
+    {
+      if (!chunk.changed.test(TRANSFORM))
+      {
+        continue;
+      }
+
+      const Transform* transforms = archetype->GetColumn<Transform>(chunk, archetype->FindColumn(TRANSFORM));
+      LocalToWorld* localToWorlds = archetype->GetColumn<LocalToWorld>(chunk, archetype->FindColumn(LOCAL_TO_WORLD));
+
+      for (unsigned int i = 0u;
+           i < chunk.count;
+           i++)
+      {
+        localToWorlds[i].matrix = CreateTransformation(transforms[i]);
+      }
+
+      chunk.changed.set(LOCAL_TO_WORLD);
+      anyChanged = true;
+    }
+  }
+
+  // If nothing has moved, the children can't have either
+  if (anyChanged || childrenChanged)
+  {
+    for (Archetype* archetype : entities.GetArchetypes())
+    {
+      if ((archetype->signature & query) != query || !archetype->signature.test(PARENT))
+      {
+        continue;
+      }
+
+      for (const Chunk& chunk : archetype->chunks)
+      {
+        const Entity* children = archetype->GetEntities(chunk);
+
+        for (unsigned int i = 0u;
+             i < chunk.count;
+             i++)
+        {
+          anyChanged |= UpdateChild(entities, children[i]);
+        }
+      }
+    }
+  }
+
+  for (Archetype* archetype : entities.GetArchetypes())
+  {
+    for (Chunk& chunk : archetype->chunks)
+    {
+      chunk.changed.reset(TRANSFORM);
+      chunk.changed.reset(PARENT);
+    }
+  }
+
+  return anyChanged;
+}
+
+// --- Component types ---
+static const ComponentType* g_componentTypes[MAX_COMPONENTS];
+static ComponentId g_numComponentTypes = 0u;
+static std::mutex g_componentTypesLock;
+
+ComponentId RegisterComponentType(const ComponentType* type)
+{
+  std::lock_guard<std::mutex> guard(g_componentTypesLock);
+
+  if (g_numComponentTypes == MAX_COMPONENTS)
+  {
+    fprintf(stderr, "FATAL: Too many types of component (increase MAX_COMPONENTS)\n");
+    exit(1);
+  }
+
+  g_componentTypes[g_numComponentTypes] = type;
+  return g_numComponentTypes++;
+}
+
+const ComponentType* GetComponentType(ComponentId id)
+{
+  return g_componentTypes[id];
+}
+
+// --- Archetypes ---
+/*
+ * NOTE(Isaac): `size` has to be a multiple of `CHUNK_ALIGNMENT`, as `aligned_alloc` needs it to be.
+ */
+static uint8_t* AllocateChunkMemory(size_t size)
+{
+  uint8_t* chunk = static_cast<uint8_t*>(aligned_alloc(CHUNK_ALIGNMENT, size));
+
+  if (!chunk)
+  {
+    fprintf(stderr, "FATAL: Ran out of memory allocating a chunk of entities (%zu bytes)\n", size);
+    exit(1);
+  }
+
+  return chunk;
+}
+
+ChunkPool::ChunkPool()
+  :freeList(nullptr)
+  ,numAllocated(0u)
+  ,numFree(0u)
+{
+}
+
+ChunkPool::~ChunkPool()
+{
+  while (freeList)
+  {
+    uint8_t* chunk = freeList;
+    memcpy(&freeList, chunk, sizeof(uint8_t*));
+    free(chunk);
+  }
+}
+
+uint8_t* ChunkPool::Allocate()
+{
+  if (!freeList)
+  {
+    uint8_t* chunk = AllocateChunkMemory(CHUNK_SIZE);
+    numAllocated++;
+    return chunk;
+  }
+
+  uint8_t* chunk = freeList;
+  memcpy(&freeList, chunk, sizeof(uint8_t*));
+  numFree--;
+  return chunk;
+}
+
+void ChunkPool::Free(uint8_t* chunk)
+{
+  memcpy(chunk, &freeList, sizeof(uint8_t*));
+  freeList = chunk;
+  numFree++;
+}
+
+static size_t AlignUp(size_t value, size_t alignment)
+{
+  return (value + alignment - 1u) & ~(alignment - 1u);
+}
+
+Archetype::Archetype(const Signature& signature, ChunkPool& pool)
+  :signature(signature)
+  ,columns()
+  ,ids()
+  ,types()
+  ,offsets()
+  ,chunkSize(0u)
+  ,chunkCapacity(0u)
+  ,chunks()
+  ,count(0u)
+  ,pool(pool)
+{
+  for (ComponentId id = 0u;
+       id < MAX_COMPONENTS;
+       id++)
+  {
+    if (signature.test(id))
+    {
+      columns[id] = static_cast<int8_t>(ids.size());
+      ids.push_back(id);
+      types.push_back(GetComponentType(id));
+    }
+    else
+    {
+      columns[id] = -1;
+    }
+  }
+
+  offsets.resize(types.size());
+
+  size_t entitySize = sizeof(Entity);
+  for (const ComponentType* type : types)
+  {
+    entitySize += type->size;
+  }
+
+  /*
+   * Start with as many entities as would fit if there was no padding between the arrays, then back off until the
+   * padding fits too. If an entity doesn't fit in a chunk at all, the chunks for this archetype are just bigger
+   * (and can't come from the pool).
+   */
+  chunkCapacity = std::max(CHUNK_SIZE / static_cast<unsigned int>(entitySize), 1u);
+
+  while (true)
+  {
+    size_t size = AlignUp(sizeof(Entity) * chunkCapacity, CHUNK_ALIGNMENT);
+
+    for (unsigned int i = 0u;
+         i < types.size();
+         i++)
+    {
+      offsets[i] = AlignUp(size, types[i]->alignment);
+      size = offsets[i] + types[i]->size * chunkCapacity;
+    }
+
+    if (size <= CHUNK_SIZE || chunkCapacity == 1u)
+    {
+      chunkSize = AlignUp(size, CHUNK_ALIGNMENT);
+      break;
+    }
+
+    chunkCapacity--;
+  }
 }
 
-Entity::Entity(const std::string& name)
-  :name(name)
-  ,componentMap()
+Archetype::~Archetype()
 {
+  Clear();
 }
 
-void Entity::Update(float delta)
+uint8_t* Archetype::AllocateChunk()
 {
-  for (auto& mapping : componentMap)
+  if (chunkSize <= CHUNK_SIZE)
   {
-    (mapping.second)->Update(delta);
+    return pool.Allocate();
   }
+
+  // NOTE(Isaac): `chunkSize` is always a multiple of the alignment
+  return AllocateChunkMemory(chunkSize);
+}
+
+void Archetype::FreeChunk(uint8_t* chunk)
+{
+  if (chunkSize <= CHUNK_SIZE)
+  {
+    pool.Free(chunk);
+  }
+  else
+  {
+    free(chunk);
+  }
+}
+
+unsigned int Archetype::Add(Entity entity)
+{
+  if (count == chunks.size() * chunkCapacity)
+  {
+    chunks.push_back(Chunk{AllocateChunk(), 0u, Signature()});
+  }
+
+  unsigned int row = count++;
+  Chunk& chunk = chunks[row / chunkCapacity];
+  GetEntities(chunk)[chunk.count++] = entity;
+  chunk.changed |= signature;
+  return row;
+}
+
+Entity Archetype::Remove(unsigned int row)
+{
+  const unsigned int last = count - 1u;
+  Entity moved = NULL_ENTITY;
+
+  for (unsigned int i = 0u;
+       i < types.size();
+       i++)
+  {
+    types[i]->destroy(GetComponent(i, row));
+
+    if (row != last)
+    {
+      types[i]->move(GetComponent(i, row), GetComponent(i, last));
+      types[i]->destroy(GetComponent(i, last));
+    }
+  }
+
+  if (row != last)
+  {
+    moved = GetEntities(chunks[last / chunkCapacity])[last % chunkCapacity];
+    GetEntities(chunks[row / chunkCapacity])[row % chunkCapacity] = moved;
+    chunks[row / chunkCapacity].changed |= signature;
+  }
+
+  count--;
+  Chunk& lastChunk = chunks.back();
+  lastChunk.count--;
+
+  if (lastChunk.count == 0u)
+  {
+    FreeChunk(lastChunk.data);
+    chunks.pop_back();
+  }
+
+  return moved;
+}
+
+void Archetype::Clear()
+{
+  for (Chunk& chunk : chunks)
+  {
+    for (unsigned int i = 0u;
+         i < types.size();
+         i++)
+    {
+      uint8_t* column = chunk.data + offsets[i];
+
+      for (unsigned int j = 0u;
+           j < chunk.count;
+           j++)
+      {
+        types[i]->destroy(column + j * types[i]->size);
+      }
+    }
+
+    FreeChunk(chunk.data);
+  }
+
+  chunks.clear();
+  count = 0u;
+}
+
+// --- Entities ---
+EntityManager::EntityManager()
+  :chunkPool()
+  ,archetypes()
+  ,locations()
+  ,firstFree(NULL_ENTITY)
+  ,lastFree(NULL_ENTITY)
+{
+}
+
+EntityManager::~EntityManager()
+{
+  for (Archetype* archetype : archetypes)
+  {
+    delete archetype;
+  }
+}
+
+/*
+ * Takes the oldest free slot, or makes a new one if there aren't any.
+ */
+Entity EntityManager::AllocateEntity()
+{
+  if (firstFree == NULL_ENTITY)
+  {
+    if (locations.size() == MAX_ENTITIES)
+    {
+      fprintf(stderr, "FATAL: Too many entities (the most there can be is %u)\n", MAX_ENTITIES);
+      exit(1);
+    }
+
+    locations.push_back(EntityLocation{Signature(), nullptr, 0u, 0u});
+    return MakeEntity(static_cast<uint32_t>(locations.size() - 1u), 0u);
+  }
+
+  uint32_t index = firstFree;
+  firstFree = locations[index].row;
+
+  if (firstFree == NULL_ENTITY)
+  {
+    lastFree = NULL_ENTITY;
+  }
+
+  return MakeEntity(index, locations[index].generation);
+}
+
+/*
+ * Puts the slot on the end of the free list, and moves it onto its next generation so any handles to the entity
+ * that was in it stop working.
+ */
+void EntityManager::FreeSlot(uint32_t index)
+{
+  EntityLocation& location = locations[index];
+  location.signature.reset();
+  location.archetype = nullptr;
+  location.row = NULL_ENTITY;
+  location.generation = (location.generation + 1u) & ENTITY_GENERATION_MASK;
+
+  if (lastFree == NULL_ENTITY)
+  {
+    firstFree = index;
+  }
+  else
+  {
+    locations[lastFree].row = index;
+  }
+
+  lastFree = index;
+}
+
+void EntityManager::Destroy(Entity entity)
+{
+  if (!IsAlive(entity))
+  {
+    return;
+  }
+
+  EntityLocation& location = locations[GetEntityIndex(entity)];
+  Entity moved = location.archetype->Remove(location.row);
+
+  if (moved != NULL_ENTITY)
+  {
+    locations[GetEntityIndex(moved)].row = location.row;
+  }
+
+  FreeSlot(GetEntityIndex(entity));
+}
+
+/*
+ * NOTE(Isaac): we keep the slots (and the chunks, in the pool), so filling the world back up again afterwards
+ * doesn't have to allocate anything.
+ */
+void EntityManager::Clear()
+{
+  for (Archetype* archetype : archetypes)
+  {
+    archetype->Clear();
+  }
+
+  for (uint32_t i = 0u;
+       i < locations.size();
+       i++)
+  {
+    if (locations[i].archetype)
+    {
+      FreeSlot(i);
+    }
+  }
+}
+
+unsigned int EntityManager::NumEntities() const
+{
+  unsigned int count = 0u;
+
+  for (const Archetype* archetype : archetypes)
+  {
+    count += archetype->count;
+  }
+
+  return count;
+}
+
+Archetype* EntityManager::FindArchetype(const Signature& signature)
+{
+  for (Archetype* archetype : archetypes)
+  {
+    if (archetype->signature == signature)
+    {
+      return archetype;
+    }
+  }
+
+  Archetype* archetype = new Archetype(signature, chunkPool);
+  archetypes.push_back(archetype);
+  return archetype;
+}
+
+/*
+ * Moves all of the components the entity's current archetype shares with the new one over, and destroys the
+ * rest. Components the new archetype has, but the old one doesn't, are left for the caller to construct.
+ */
+void EntityManager::MoveEntity(Entity entity, Archetype* archetype)
+{
+  EntityLocation& location = locations[GetEntityIndex(entity)];
+  Archetype* from = location.archetype;
+  unsigned int row = archetype->Add(entity);
+
+  for (unsigned int i = 0u;
+       i < from->types.size();
+       i++)
+  {
+    int column = archetype->FindColumn(from->ids[i]);
+
+    if (column != -1)
+    {
+      from->types[i]->move(archetype->GetComponent(column, row), from->GetComponent(i, location.row));
+    }
+  }
+
+  // NOTE(Isaac): this destroys what's left of the components we've moved, as well as the ones we haven't
+  Entity moved = from->Remove(location.row);
+  if (moved != NULL_ENTITY)
+  {
+    locations[GetEntityIndex(moved)].row = location.row;
+  }
+
+  location.signature = archetype->signature;
+  location.archetype = archetype;
+  location.row = row;
 }
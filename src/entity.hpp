@@ -6,73 +6,529 @@
 #pragma once
 
 #include <maths.hpp>
-#include <string>
-#include <typeindex>
-#include <typeinfo>
+#include <cstdint>
+#include <cstddef>
+#include <new>
+#include <tuple>
+#include <bitset>
+#include <utility>
+#include <vector>
 #include <type_traits>
-#include <unordered_map>
 #include <platform.hpp>
+#include <asset.hpp>
 
-struct Mesh;
-struct Texture;
-struct Entity;
+// --- Handles ---
+/*
+ * An entity is a handle: the low bits are the index of its slot, and the high bits are the slot's generation,
+ * which goes up every time the entity in that slot is destroyed. This means a handle to an entity that's gone
+ * stops working, even if its slot has been reused (until the generation wraps around).
+ */
+typedef uint32_t Entity;
+#define ENTITY_INDEX_BITS 20u
+#define ENTITY_INDEX_MASK ((1u << ENTITY_INDEX_BITS) - 1u)
+#define ENTITY_GENERATION_MASK ((1u << (32u - ENTITY_INDEX_BITS)) - 1u)
+#define NULL_ENTITY 0xFFFFFFFFu
+#define MAX_ENTITIES ENTITY_INDEX_MASK    // NOTE(Isaac): so `NULL_ENTITY`'s index is never a real slot
+
+inline uint32_t GetEntityIndex(Entity entity)
+{
+  return entity & ENTITY_INDEX_MASK;
+}
+
+inline uint32_t GetEntityGeneration(Entity entity)
+{
+  return entity >> ENTITY_INDEX_BITS;
+}
 
-struct Component
+inline Entity MakeEntity(uint32_t index, uint32_t generation)
 {
-  Component();
-  virtual ~Component() { }
+  return ((generation & ENTITY_GENERATION_MASK) << ENTITY_INDEX_BITS) | index;
+}
 
-  virtual void Update(float delta) = 0;
+// --- Components ---
+/*
+ * Components are plain data - anything that acts on them is a system, which is just a function that walks over
+ * the entities with the components it needs (see `EntityManager::ForEach`). Where an entity is is its
+ * `Transform` component.
+ */
+struct Renderable
+{
+  Renderable(MeshHandle mesh, TextureHandle texture);
 
-  Entity* parent;
+  MeshHandle    mesh;
+  TextureHandle texture;
 };
 
-struct Renderable : Component
+struct Controllable
 {
-  Renderable(Mesh* mesh, Texture* texture);
+  Controllable(Controller* controller);
 
-  void Update(float delta);
+  Controller* controller;
+};
 
-  Mesh*     mesh;
-  Texture*  texture;
+/*
+ * An entity's transform, as a matrix from its space to the world's. These are worked out from the entities'
+ * `Transform`s (and parents) by `UpdateWorldTransforms`, and only when something has changed, so they're what
+ * anything that doesn't need to change the transform (e.g. the renderer) should use.
+ */
+struct LocalToWorld
+{
+  Mat<4u> matrix;
 };
 
-struct Controllable : Component
+/*
+ * Makes an entity's `Transform` relative to another entity, which must have a `LocalToWorld` too. Children
+ * should be destroyed along with their parents: if the parent's gone, the child's transform stays as it was
+ * until its own `Transform` changes, and then it's relative to the world instead.
+ */
+struct Parent
 {
-  Controllable(Controller* controller);
+  Parent(Entity entity);
 
-  void Update(float delta);
+  Entity    entity;
+  Mat<4u>   localToParent;  // Cached from the child's `Transform`
+  uint32_t  pass;           // NOTE(Isaac): the last pass of `UpdateWorldTransforms` that got to this entity
+  uint32_t  movedPass;      // NOTE(Isaac): the last pass that changed its `LocalToWorld`
+};
 
-  Controller* controller;
+/*
+ * Each type of component gets a small integer ID the first time it's used, so sets of components can be stored
+ * as bitsets, and looking one up is just indexing an array.
+ */
+typedef uint32_t ComponentId;
+#define MAX_COMPONENTS 64u
+typedef std::bitset<MAX_COMPONENTS> Signature;
+
+/*
+ * Everything we need to know to store a type of component, without knowing what it is.
+ */
+struct ComponentType
+{
+  size_t  size;
+  size_t  alignment;
+  void    (*move)(void* to, void* from);  // Move-constructs a component into uninitialised memory
+  void    (*destroy)(void* component);
+};
+
+/*
+ * Returns the new type's ID. Types are never unregistered, so an ID always means the same type. Types are
+ * registered the first time their ID is asked for, which can be from any thread.
+ */
+ComponentId RegisterComponentType(const ComponentType* type);
+const ComponentType* GetComponentType(ComponentId id);
+
+template<typename T>
+struct ComponentFamily
+{
+  static ComponentId Register()
+  {
+    static const ComponentType type =
+      {
+        sizeof(T),
+        alignof(T),
+        [](void* to, void* from) { new (to) T(std::move(*static_cast<T*>(from))); },
+        [](void* component) { static_cast<T*>(component)->~T(); }
+      };
+
+    return RegisterComponentType(&type);
+  }
+
+  /*
+   * NOTE(Isaac): this is a static local, rather than a static member, because the order static members of
+   * templates are initialised in isn't defined - something else being initialised before `main` could see the
+   * ID before it's been set. After the first call, the guard is just a load and a well-predicted branch.
+   */
+  static ComponentId GetId()
+  {
+    static const ComponentId id = Register();
+    return id;
+  }
+};
+
+template<typename T>
+ComponentId GetComponentId()
+{
+  return ComponentFamily<std::remove_cv_t<std::remove_reference_t<T>>>::GetId();
+}
+
+template<typename... Ts>
+Signature MakeSignature()
+{
+  Signature signature;
+  (signature.set(GetComponentId<Ts>()), ...);
+  return signature;
+}
+
+// --- Archetypes ---
+/*
+ * Chunks are a fixed size, so an archetype with smaller components fits more entities in each one.
+ */
+#define CHUNK_SIZE (16u*1024u)
+#define CHUNK_ALIGNMENT 64u
+
+/*
+ * `changed` is a dirty flag for each type of component in the chunk. Whenever an entity is put in the chunk, all
+ * of them are set, and the scheduler sets the ones each system writes to in the chunks it runs over. It's up to
+ * whatever looks at them to clear them (e.g. `UpdateWorldTransforms` clears the `Transform` flags, and the
+ * renderer clears the `LocalToWorld` ones once it's uploaded them).
+ */
+struct Chunk
+{
+  uint8_t*      data;
+  unsigned int  count;
+  Signature     changed;
+};
+
+/*
+ * Chunks are recycled rather than freed, so once there are enough of them, creating and destroying entities
+ * doesn't touch the heap at all. The free chunks are kept in a list threaded through the chunks themselves.
+ */
+struct ChunkPool
+{
+  ChunkPool();
+  ~ChunkPool();
+
+  ChunkPool(const ChunkPool&) = delete;
+  ChunkPool& operator=(const ChunkPool&) = delete;
+
+  /*
+   * Chunks from the pool are always `CHUNK_SIZE` bytes.
+   */
+  uint8_t* Allocate();
+  void Free(uint8_t* chunk);
+
+  uint8_t*      freeList;
+  unsigned int  numAllocated;   // NOTE(Isaac): including the free ones
+  unsigned int  numFree;
+};
+
+/*
+ * Every entity with exactly the same set of components lives in the same archetype. Within each chunk, there's
+ * one array per type of component, and one of the entities themselves (so we know whose components they are).
+ * Entities are packed into the chunks with no gaps, so every chunk is full apart from the last one.
+ */
+struct Archetype
+{
+  Archetype(const Signature& signature, ChunkPool& pool);
+  ~Archetype();
+
+  Archetype(const Archetype&) = delete;
+  Archetype& operator=(const Archetype&) = delete;
+
+  /*
+   * Returns the index of the given type's array, or -1 if entities of this archetype don't have it.
+   */
+  int FindColumn(ComponentId id) const
+  {
+    return columns[id];
+  }
+
+  /*
+   * Adds room for an entity to the end of the last chunk and returns its row. Its components are left
+   * uninitialised, so the caller has to construct them.
+   */
+  unsigned int Add(Entity entity);
+
+  /*
+   * Destroys the components in the given row, and fills the gap with the last entity. Returns the entity that
+   * was moved into the row, or `NULL_ENTITY` if it was already the last one.
+   */
+  Entity Remove(unsigned int row);
+  void Clear();
+
+  Entity* GetEntities(const Chunk& chunk) const
+  {
+    return reinterpret_cast<Entity*>(chunk.data);
+  }
+
+  template<typename T>
+  T* GetColumn(const Chunk& chunk, int column) const
+  {
+    return reinterpret_cast<T*>(chunk.data + offsets[column]);
+  }
+
+  uint8_t* GetComponent(int column, unsigned int row) const
+  {
+    return chunks[row / chunkCapacity].data + offsets[column] + (row % chunkCapacity) * types[column]->size;
+  }
+
+  Signature                         signature;
+  int8_t                            columns[MAX_COMPONENTS];  // Indexed by ID, or -1 if we don't have it
+  std::vector<ComponentId>          ids;      // Of each column, in order
+  std::vector<const ComponentType*> types;
+  std::vector<size_t>               offsets;  // Of each type's array within a chunk
+  size_t                            chunkSize;
+  unsigned int                      chunkCapacity;
+  std::vector<Chunk>                chunks;
+  unsigned int                      count;
+  ChunkPool&                        pool;
+
+private:
+  uint8_t* AllocateChunk();
+  void FreeChunk(uint8_t* chunk);
+};
+
+template<typename... Ts, typename F, size_t... Is>
+void ForEachInChunk(const Archetype& archetype, const Chunk& chunk, F& function, std::index_sequence<Is...>)
+{
+  const Entity* entities = archetype.GetEntities(chunk);
+  std::tuple<Ts*...> arrays(archetype.GetColumn<Ts>(chunk, archetype.FindColumn(GetComponentId<Ts>()))...);
+
+  for (unsigned int i = 0u;
+       i < chunk.count;
+       i++)
+  {
+    function(entities[i], std::get<Is>(arrays)[i]...);
+  }
+}
+
+/*
+ * Calls `function(entity, components...)` for every entity in one of an archetype's chunks. The archetype has
+ * to have all of the components.
+ */
+template<typename... Ts, typename F>
+void ForEachInChunk(const Archetype& archetype, const Chunk& chunk, F& function)
+{
+  ForEachInChunk<Ts...>(archetype, chunk, function, std::index_sequence_for<Ts...>());
+}
+
+// --- Entities ---
+/*
+ * NOTE(Isaac): the signature is a copy of the archetype's, so checking whether an entity has a component doesn't
+ * have to touch the archetype at all.
+ */
+struct EntityLocation
+{
+  Signature     signature;
+  Archetype*    archetype;    // NOTE(Isaac): null if the slot is free
+  unsigned int  row;          // NOTE(Isaac): if the slot is free, this is the index of the next free one instead
+  uint32_t      generation;
 };
 
-struct Entity
+/*
+ * Owns every entity and its components. Adding a component to, or removing one from, an entity moves it (and all
+ * of its components) to a different archetype, so pointers to components are only valid until the next time
+ * an entity is created, destroyed or changed. Handles stay valid until the entity is destroyed.
+ *
+ * Free slots are reused oldest first, so it takes as long as possible for a slot's generation to wrap around.
+ */
+struct EntityManager
 {
-  Entity(const std::string& name);
+  EntityManager();
+  ~EntityManager();
 
-  void Update(float delta);
+  EntityManager(const EntityManager&) = delete;
+  EntityManager& operator=(const EntityManager&) = delete;
 
+  template<typename... Ts>
+  Entity Create(Ts&&... components)
+  {
+    Archetype* archetype = FindArchetype(MakeSignature<Ts...>());
+    Entity entity = AllocateEntity();
+    unsigned int row = archetype->Add(entity);
+
+    EntityLocation& location = locations[GetEntityIndex(entity)];
+    location.signature = archetype->signature;
+    location.archetype = archetype;
+    location.row = row;
+
+    (new (archetype->GetComponent(archetype->FindColumn(GetComponentId<Ts>()), row))
+       std::decay_t<Ts>(std::forward<Ts>(components)), ...);
+    return entity;
+  }
+
+  /*
+   * Destroying an entity that's already gone does nothing.
+   */
+  void Destroy(Entity entity);
+  void Clear();
+
+  bool IsAlive(Entity entity) const
+  {
+    const uint32_t index = GetEntityIndex(entity);
+    return index < locations.size() && locations[index].archetype &&
+           locations[index].generation == GetEntityGeneration(entity);
+  }
+
+  /*
+   * Entities that have been destroyed don't have any components. Anything written through the pointer has to
+   * be followed by `MarkChanged`, so it isn't missed by anything looking at the chunks' dirty flags.
+   */
   template<typename T>
-  T* GetComponent()
+  T* GetComponent(Entity entity)
   {
-    return dynamic_cast<T*>(componentMap[typeid(T)]);
+    const ComponentId id = GetComponentId<T>();
+
+    if (!IsAlive(entity) || !locations[GetEntityIndex(entity)].signature.test(id))
+    {
+      return nullptr;
+    }
+
+    const EntityLocation& location = locations[GetEntityIndex(entity)];
+
+    return reinterpret_cast<T*>(location.archetype->GetComponent(location.archetype->FindColumn(id), location.row));
   }
 
   template<typename T>
-  const T* GetComponent() const
+  bool HasComponent(Entity entity) const
   {
-    return dynamic_cast<T*>(componentMap.at(typeid(T)));
+    return IsAlive(entity) && locations[GetEntityIndex(entity)].signature.test(GetComponentId<T>());
   }
 
   template<typename T>
-  void AddComponent(T* component)
+  void MarkChanged(Entity entity)
   {
-    static_assert(std::is_base_of<Component, T>::value, "Can only add component if base class is Component");
-    componentMap[typeid(T)] = component;
-    component->parent = this;
+    Chunk* chunk = GetChunk(entity);
+
+    if (chunk)
+    {
+      chunk->changed.set(GetComponentId<T>());
+    }
   }
 
-  std::string                                     name;
-  Transform                                       transform;
-  std::unordered_map<std::type_index, Component*> componentMap;
+  /*
+   * Returns the chunk the entity's components are in, or null if it's been destroyed.
+   */
+  Chunk* GetChunk(Entity entity)
+  {
+    if (!IsAlive(entity))
+    {
+      return nullptr;
+    }
+
+    const EntityLocation& location = locations[GetEntityIndex(entity)];
+    return &(location.archetype->chunks[location.row / location.archetype->chunkCapacity]);
+  }
+
+  /*
+   * Returns where the entity's components are stored, or null if it's been destroyed. Like pointers to its
+   * components, this is only valid until the next time an entity is created, destroyed or changed.
+   */
+  const EntityLocation* GetLocation(Entity entity) const
+  {
+    return IsAlive(entity) ? &(locations[GetEntityIndex(entity)]) : nullptr;
+  }
+
+  /*
+   * If the entity already has a component of this type, it's replaced.
+   */
+  template<typename T>
+  void AddComponent(Entity entity, T component)
+  {
+    if (!IsAlive(entity))
+    {
+      return;
+    }
+
+    T* existing = GetComponent<T>(entity);
+
+    if (existing)
+    {
+      *existing = std::move(component);
+      MarkChanged<T>(entity);
+      return;
+    }
+
+    const ComponentId id = GetComponentId<T>();
+    EntityLocation& location = locations[GetEntityIndex(entity)];
+    Archetype* archetype = FindArchetype(Signature(location.signature).set(id));
+
+    MoveEntity(entity, archetype);
+    new (archetype->GetComponent(archetype->FindColumn(id), location.row)) T(std::move(component));
+  }
+
+  template<typename T>
+  void RemoveComponent(Entity entity)
+  {
+    if (!HasComponent<T>(entity))
+    {
+      return;
+    }
+
+    const EntityLocation& location = locations[GetEntityIndex(entity)];
+    MoveEntity(entity, FindArchetype(Signature(location.signature).reset(GetComponentId<T>())));
+  }
+
+  /*
+   * Calls `function(entity, components...)` for every entity that has all of the given components (and maybe
+   * some others too). Within each chunk, this is a straight walk over its arrays. Components that are only read
+   * can be asked for as `const`. `function` mustn't create or destroy entities, or add or remove components.
+   */
+  template<typename... Ts, typename F>
+  void ForEach(F function)
+  {
+    static_assert(sizeof...(Ts) > 0u, "Need at least one type of component to look for");
+    const Signature query = MakeSignature<Ts...>();
+
+    for (Archetype* archetype : archetypes)
+    {
+      if ((archetype->signature & query) != query)
+      {
+        continue;
+      }
+
+      for (const Chunk& chunk : archetype->chunks)
+      {
+        ForEachInChunk<Ts...>(*archetype, chunk, function);
+      }
+    }
+  }
+
+  /*
+   * How many entities `ForEach` would visit with the same components.
+   */
+  template<typename... Ts>
+  unsigned int Count() const
+  {
+    const Signature query = MakeSignature<Ts...>();
+    unsigned int count = 0u;
+
+    for (const Archetype* archetype : archetypes)
+    {
+      if ((archetype->signature & query) == query)
+      {
+        count += archetype->count;
+      }
+    }
+
+    return count;
+  }
+
+  unsigned int NumEntities() const;
+
+  const std::vector<Archetype*>& GetArchetypes() const
+  {
+    return archetypes;
+  }
+
+  const ChunkPool& GetChunkPool() const
+  {
+    return chunkPool;
+  }
+
+private:
+  ChunkPool                   chunkPool;
+  std::vector<Archetype*>     archetypes;
+  std::vector<EntityLocation> locations;    // Indexed by each entity's index
+  uint32_t                    firstFree;    // NOTE(Isaac): the ends of the list of free slots, or `NULL_ENTITY`
+  uint32_t                    lastFree;
+
+  Entity AllocateEntity();
+  void FreeSlot(uint32_t index);
+  Archetype* FindArchetype(const Signature& signature);
+  void MoveEntity(Entity entity, Archetype* archetype);
 };
+
+// --- Systems ---
+/*
+ * See `SystemScheduler` for how these are run.
+ */
+void UpdateControllable(float delta, Entity entity, Transform& transform, const Controllable& controllable);
+
+/*
+ * Brings every entity's `LocalToWorld` up to date with its `Transform`, and its parent's `LocalToWorld`. Only the
+ * chunks whose `Transform`s or `Parent`s have changed (plus the children of anything that has moved) are looked
+ * at, so entities that don't move cost nothing. The chunks whose `LocalToWorld`s change are flagged, and the
+ * flags are left for whatever uses them. Returns whether any of them have changed.
+ */
+bool UpdateWorldTransforms(EntityManager& entities);
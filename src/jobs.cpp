@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2017, Isaac Woods.
+ * See LICENCE.md
+ */
+
+#include <jobs.hpp>
+#include <algorithm>
+
+JobSystem::JobSystem(unsigned int numThreads)
+  :workers()
+  ,jobs()
+  ,lock()
+  ,jobAdded()
+  ,jobFinished()
+  ,numUnfinished(0u)
+  ,quit(false)
+{
+  if (numThreads == 0u)
+  {
+    // NOTE(Isaac): this can return 0 if it doesn't know, so we always want at least one worker
+    numThreads = std::max(std::thread::hardware_concurrency(), 2u) - 1u;
+  }
+
+  for (unsigned int i = 0u;
+       i < numThreads;
+       i++)
+  {
+    workers.push_back(std::thread(&JobSystem::WorkerMain, this));
+  }
+}
+
+JobSystem::~JobSystem()
+{
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    quit = true;
+  }
+
+  jobAdded.notify_all();
+
+  for (std::thread& worker : workers)
+  {
+    worker.join();
+  }
+}
+
+void JobSystem::Submit(std::function<void()> job)
+{
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    jobs.push_back(Job{std::move(job), nullptr});
+    numUnfinished++;
+  }
+
+  jobAdded.notify_one();
+}
+
+void JobSystem::Submit(std::function<void()> job, JobGroup& group)
+{
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    jobs.push_front(Job{std::move(job), &group});
+    numUnfinished++;
+    group.numUnfinished++;
+  }
+
+  jobAdded.notify_one();
+}
+
+void JobSystem::WaitIdle()
+{
+  std::unique_lock<std::mutex> guard(lock);
+  jobFinished.wait(guard, [this]() { return numUnfinished == 0u; });
+}
+
+void JobSystem::Wait(JobGroup& group)
+{
+  std::unique_lock<std::mutex> guard(lock);
+
+  while (group.numUnfinished > 0u)
+  {
+    auto next = std::find_if(jobs.begin(), jobs.end(), [&group](const Job& job) { return job.group == &group; });
+
+    // NOTE(Isaac): the rest of the group has already been started by the workers, so there's nothing to help with
+    if (next == jobs.end())
+    {
+      jobFinished.wait(guard);
+      continue;
+    }
+
+    Job job = std::move(*next);
+    jobs.erase(next);
+
+    guard.unlock();
+    job.function();
+    guard.lock();
+
+    numUnfinished--;
+    group.numUnfinished--;
+    jobFinished.notify_all();
+  }
+}
+
+unsigned int JobSystem::NumThreads() const
+{
+  return static_cast<unsigned int>(workers.size());
+}
+
+void JobSystem::WorkerMain()
+{
+  while (true)
+  {
+    Job job;
+
+    {
+      std::unique_lock<std::mutex> guard(lock);
+      jobAdded.wait(guard, [this]() { return quit || !jobs.empty(); });
+
+      // NOTE(Isaac): we finish off anything that's already been queued before quitting
+      if (jobs.empty())
+      {
+        break;
+      }
+
+      job = std::move(jobs.front());
+      jobs.pop_front();
+    }
+
+    job.function();
+
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      numUnfinished--;
+
+      if (job.group)
+      {
+        job.group->numUnfinished--;
+      }
+    }
+
+    jobFinished.notify_all();
+  }
+}
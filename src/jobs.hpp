@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2017, Isaac Woods.
+ * See LICENCE.md
+ */
+
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+/*
+ * A set of jobs that can be waited on together, without having to wait for every other job as well.
+ */
+struct JobGroup
+{
+  JobGroup()
+    :numUnfinished(0u)
+  { }
+
+  unsigned int numUnfinished;   // NOTE(Isaac): protected by the job system's lock
+};
+
+/*
+ * A pool of worker threads that jobs can be handed off to. Jobs are run in the order they're submitted, but
+ * any number of them can be running at once, so they shouldn't depend on each other. Jobs can't touch GL,
+ * because the workers don't have a context.
+ */
+struct JobSystem
+{
+  JobSystem(unsigned int numThreads=0u);    // NOTE(Isaac): 0 means one per core, leaving one for the main thread
+  ~JobSystem();
+
+  void Submit(std::function<void()> job);
+
+  /*
+   * Jobs in a group have someone waiting on them, so they go in front of any ungrouped jobs (e.g. asset loads)
+   * that haven't started yet. Jobs can submit more jobs to their own group.
+   */
+  void Submit(std::function<void()> job, JobGroup& group);
+
+  /*
+   * Waits until every job that's been submitted has finished.
+   */
+  void WaitIdle();
+
+  /*
+   * Waits until every job in the group has finished. Rather than just sleeping, the calling thread runs the
+   * group's jobs too, while there are any left that haven't started.
+   */
+  void Wait(JobGroup& group);
+
+  unsigned int NumThreads() const;
+
+private:
+  struct Job
+  {
+    std::function<void()> function;
+    JobGroup*             group;    // NOTE(Isaac): null if it's not part of a group
+  };
+
+  std::vector<std::thread>          workers;
+  std::deque<Job>                   jobs;
+  std::mutex                        lock;
+  std::condition_variable           jobAdded;
+  std::condition_variable           jobFinished;
+  unsigned int                      numUnfinished;    // NOTE(Isaac): queued or running
+  bool                              quit;
+
+  void WorkerMain();
+};
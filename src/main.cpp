@@ -5,10 +5,14 @@
 
 #include <thread>
 #include <chrono>
+#include <random>
 #include <platform.hpp>
 #include <asset.hpp>
 #include <world.hpp>
 #include <rendering.hpp>
+#include <jobs.hpp>
+#include <scheduler.hpp>
+#include <archive.hpp>
 #include <imgui/imgui.hpp>
 
 static inline float GetTime()
@@ -17,29 +21,145 @@ static inline float GetTime()
   return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - EPOCH).count() / 1e9f;
 }
 
+/*
+ * Pans with WASD/the arrow keys, and zooms towards the cursor with the scroll wheel.
+ */
+static void UpdateCamera(Camera& camera, float delta)
+{
+  static const float PAN_SPEED = 800.0f;    // NOTE(Isaac): in pixels per second, so it feels the same at any zoom
+  static const float ZOOM_STEP = 1.1f;
+
+  if (!ImGui::GetIO().WantCaptureKeyboard)
+  {
+    Vec<2u> pan;
+    if (g_keys[KEY_W] || g_keys[KEY_UP])    pan += Vec<2u>(0.0f, 1.0f);
+    if (g_keys[KEY_S] || g_keys[KEY_DOWN])  pan -= Vec<2u>(0.0f, 1.0f);
+    if (g_keys[KEY_A] || g_keys[KEY_LEFT])  pan -= Vec<2u>(1.0f, 0.0f);
+    if (g_keys[KEY_D] || g_keys[KEY_RIGHT]) pan += Vec<2u>(1.0f, 0.0f);
+    camera.Pan(pan * PAN_SPEED * delta);
+  }
+
+  if (g_mouseScroll != 0 && !ImGui::GetIO().WantCaptureMouse)
+  {
+    camera.ZoomAt(g_mousePosition, powf(ZOOM_STEP, static_cast<float>(g_mouseScroll)));
+  }
+}
+
+/*
+ * Whether something is changing on its own, without any new input (e.g. the camera is moving while a key is
+ * held down), so we need to keep rendering.
+ */
+static bool IsAnimating(const Controller& controller)
+{
+  static const int16_t STICK_DEADZONE = 8000;
+
+  return g_keys[KEY_W] || g_keys[KEY_A] || g_keys[KEY_S] || g_keys[KEY_D] ||
+         g_keys[KEY_UP] || g_keys[KEY_DOWN] || g_keys[KEY_LEFT] || g_keys[KEY_RIGHT] ||
+         abs(controller.axes[LEFT_STICK_X]) > STICK_DEADZONE || abs(controller.axes[LEFT_STICK_Y]) > STICK_DEADZONE;
+}
+
+/*
+ * Fills the world with `count` props scattered over the map, so we can see how entity rendering scales.
+ * Alternates between the given meshes and textures, so there's more than one batch to draw.
+ */
+static void SpawnBenchmarkProps(World& world, unsigned int count, MeshHandle meshes[2u], TextureHandle textures[2u])
+{
+  world.ClearEntities();
+
+  std::mt19937 generator(1234u);
+  std::uniform_real_distribution<float> distribution(0.0f, 1.0f);
+
+  for (unsigned int i = 0u;
+       i < count;
+       i++)
+  {
+    Transform transform;
+    transform.position = Vec<3u>(distribution(generator) * world.width, distribution(generator) * world.height, -1.0f);
+    transform.rotation = Quaternion(Normalise(Vec<3u>(1.0f, 1.0f, 0.0f)), distribution(generator) * 2.0f * PI);
+    transform.scale = 6.0f;
+    // NOTE(Isaac): these are spawned between ticks, so they need their world transforms straight away
+    world.entities.Create(transform, LocalToWorld{CreateTransformation(transform)},
+                          Renderable(meshes[i % 2u], textures[(i / 2u) % 2u]));
+  }
+
+  world.MarkEntitiesMoved();
+}
+
 int main()
 {
   const unsigned int WIDTH = 1920;
   const unsigned int HEIGHT = 1080;
   const float FRAME_TIME = 1.0f / 60.0f;
   const float PROFILE_TIME = 1.0f;   // NOTE(Isaac): how often the FPS and frame time should be profiled (seconds)
+  /*
+   * How many frames to draw after something changes. ImGui takes a frame to respond to input, and another for
+   * the window to settle, so we need more than one.
+   */
+  const unsigned int REDRAW_FRAMES = 3u;
+  const unsigned int IDLE_TIMEOUT = 500u;   // NOTE(Isaac): longest we'll block waiting for input when idle (ms)
 
   InitPlatform(WIDTH, HEIGHT, true, "Suku");
+
+  /*
+   * NOTE(Isaac): files in the archive shadow the loose ones in res/, so it needs rebuilding (`make assets`)
+   * after changing anything in there. Without it, we just load the loose files instead.
+   */
+  if (!MountArchive("./res.pack"))
+  {
+    printf("Couldn't mount res.pack, so loading loose files instead\n");
+  }
+
   Controller controller;
   Renderer renderer(WIDTH, HEIGHT);
 
+  // NOTE(Isaac): this has to outlive the world, because the world's entities hold handles to its assets
+  JobSystem jobs;
+  AssetRegistry assets(jobs);
+
+  SystemScheduler systems(jobs);
+  systems.Add<Transform, const Controllable>("Controllables", UpdateControllable);
+
   PointGenerator* pointGenerator = new JitteredPointGenerator(WIDTH, HEIGHT, 30u, 30u);
   World world("test", pointGenerator, WIDTH, HEIGHT);
   delete pointGenerator;
 
+  // NOTE(Isaac): these are cooked from the .dae and .png files by the Makefile (see tools/cooker.cpp)
+  float assetStartTime = GetTime();
+  bool assetsLoaded = false;
+  MeshHandle propMeshes[2u] = { assets.LoadMesh("./res/cube.mesh"), assets.LoadMesh("./res/house.mesh") };
+  TextureHandle propTextures[2u] = { assets.LoadTexture("./res/testCube.tex"), assets.LoadTexture("./res/house.tex") };
+
   //TermHandle fpsCounterHandle = CreateTermHandle();
   float lastTime = GetTime();
   float unprocessedTime = 0.0f;
   float frameCounter = 0.0f;
   unsigned int frames = 0u;
+  float frameTime = 0.0f;         // NOTE(Isaac): average over the last profiling period (ms)
+  float renderTime = 0.0f;        // NOTE(Isaac): CPU time spent recording the last frame's commands (ms)
+  bool wasMouseDown = false;
+  bool idleRendering = true;
+  unsigned int framesToRender = REDRAW_FRAMES;
+
+  auto isIdle = [&]()
+    {
+      return idleRendering && framesToRender == 0u && !IsAnimating(controller) && !world.HasPendingChanges() &&
+             assets.NumPending() == 0u;
+    };
 
   while (true)
   {
+    /*
+     * If nothing has changed, there's no point drawing the same frame again, so we block until there's some
+     * input instead. When we wake up, we run a tick straight away, rather than trying to catch up on the time
+     * we were asleep for.
+     */
+    if (isIdle())
+    {
+      WaitForWindowEvents(IDLE_TIMEOUT);
+      lastTime = GetTime();
+      unprocessedTime = FRAME_TIME;
+    }
+
     float startTime = GetTime();
     float elapsedTime = startTime - lastTime;
     lastTime = startTime;
@@ -50,15 +170,18 @@ int main()
 
     if (frameCounter >= PROFILE_TIME)
     {
-      float totalTime = (1000.0f * frameCounter) / static_cast<float>(frames);
-      //Print(fpsCounterHandle, "Frame time: %f ms (%u fps)\n", totalTime, static_cast<unsigned int>(frames / PROFILE_TIME));
+      frameTime = (frames > 0u) ? (1000.0f * frameCounter) / static_cast<float>(frames) : 0.0f;
+      //Print(fpsCounterHandle, "Frame time: %f ms (%u fps)\n", frameTime, static_cast<unsigned int>(frames / PROFILE_TIME));
       frameCounter = 0.0f;
       frames = 0u;
     }
 
     while (unprocessedTime > FRAME_TIME)
     {
-      PollWindowEvents(controller);
+      if (PollWindowEvents(controller))
+      {
+        framesToRender = REDRAW_FRAMES;
+      }
 
       if (controller.buttons[ControllerButton::CENTRAL] || g_keys[KEY_ESCAPE])
       {
@@ -67,19 +190,77 @@ int main()
       }
 
       // --- Run a tick ---
-      //test->Update(FRAME_TIME);
+      systems.Run(world.entities, FRAME_TIME);
+
+      if (UpdateWorldTransforms(world.entities))
+      {
+        world.MarkEntitiesMoved();
+      }
+
+      UpdateCamera(renderer.camera, FRAME_TIME);
+
+      if (g_mouseButtons[LEFT_BUTTON] && !wasMouseDown && !ImGui::GetIO().WantCaptureMouse)
+      {
+        world.SelectCell(world.FindNearestCell(renderer.camera.WindowToWorld(g_mousePosition)));
+      }
+      wasMouseDown = g_mouseButtons[LEFT_BUTTON];
 
       shouldRender = true;
       unprocessedTime -= FRAME_TIME;
     }
 
+    if (isIdle())
+    {
+      shouldRender = false;
+    }
+
     if (shouldRender)
     {
       renderer.StartFrame();
+      // NOTE(Isaac): entities are culled with their meshes' bounds, which we don't know until they've loaded
+      if (assets.Update(renderer.frameStats))
+      {
+        world.MarkEntitiesMoved();
+      }
+
+      if (!assetsLoaded && assets.NumPending() == 0u)
+      {
+        printf("Loaded assets in %.3fms\n", (GetTime() - assetStartTime) * 1000.0f);
+        assetsLoaded = true;
+      }
+
+      float renderStart = GetTime();
       world.Render(renderer);
+      renderTime = 1000.0f * (GetTime() - renderStart);
+
+      ImGui::Begin("Profiling");
+      ImGui::Text("Frame time: %.2f ms", frameTime);
+      ImGui::Text("CPU record time: %.2f ms", renderTime);
+      ImGui::Text("CPU flush time: %.2f ms", renderer.stats.flushTime);
+      ImGui::Text("Draw calls: %u", renderer.stats.drawCalls);
+      ImGui::Text("State changes: %u (%u skipped)", renderer.stats.stateChanges, renderer.stats.redundantStateChanges);
+      ImGui::Text("Buffer uploads: %u (%u bytes)", renderer.stats.bufferUploads, renderer.stats.uploadedBytes);
+      ImGui::Text("Entities: %u (%u systems, %u chunks, %u free)", world.entities.NumEntities(), systems.NumSystems(),
+                  world.entities.GetChunkPool().numAllocated, world.entities.GetChunkPool().numFree);
+      ImGui::Text("Assets: %u meshes, %u textures (%u loads deduplicated, %u pending)", assets.NumMeshes(),
+                  assets.NumTextures(), assets.numDeduplicated, assets.NumPending());
+      ImGui::Text("Zoom: %.2fx", renderer.camera.zoom);
+      ImGui::Checkbox("Batch entities", &(renderer.batchEntities));
+      ImGui::Checkbox("Only render when something changes", &idleRendering);
+      if (ImGui::Button("No props"))    SpawnBenchmarkProps(world, 0u, propMeshes, propTextures);
+      ImGui::SameLine();
+      if (ImGui::Button("10k props"))   SpawnBenchmarkProps(world, 10000u, propMeshes, propTextures);
+      ImGui::SameLine();
+      if (ImGui::Button("100k props"))  SpawnBenchmarkProps(world, 100000u, propMeshes, propTextures);
+      ImGui::End();
 
       renderer.EndFrame();
       frames++;
+
+      if (framesToRender > 0u)
+      {
+        framesToRender--;
+      }
     }
     else
     {
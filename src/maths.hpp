@@ -514,6 +514,22 @@ Mat<N> Scale(float scale)
   return m;
 }
 
+template<unsigned int N>
+Mat<N> Scale(const Vec<N-1u>& scale)
+{
+  Mat<N> m;
+
+  for (unsigned int i = 0u;
+       i < N-1u;
+       i++)
+  {
+    m[i][i] = scale[i];
+  }
+
+  m[N-1u][N-1u] = 1.0f;
+  return m;
+}
+
 template<unsigned int N>
 Mat<N> Translation(const Vec<N-1u>& t)
 {
@@ -587,13 +603,13 @@ Mat<N> PerspectiveProjection(float fov, float aspectRatio, float near, float far
 }
 
 template<unsigned int N>
-Mat<N> OrthographicProjection(unsigned int width, unsigned int height, float near, float far)
+Mat<N> OrthographicProjection(float width, float height, float near, float far)
 {
   static_assert(N == 4u, "Orthographic projection matrices must be 4x4!");
   Mat<N> result(0.0f);
 
-  result[0u][0u] = 2.0f / static_cast<float>(width);
-  result[1u][1u] = 2.0f / static_cast<float>(height);
+  result[0u][0u] = 2.0f / width;
+  result[1u][1u] = 2.0f / height;
   result[2u][2u] = -2.0f / (far - near);
   result[3u][0u] = -1.0f;
   result[3u][1u] = -1.0f;
@@ -603,16 +619,60 @@ Mat<N> OrthographicProjection(unsigned int width, unsigned int height, float nea
   return result;
 }
 
+/*
+ * An axis-aligned rectangle.
+ */
+struct Rect
+{
+  Rect()
+    :min()
+    ,max()
+  { }
+
+  Rect(const Vec<2u>& min, const Vec<2u>& max)
+    :min(min)
+    ,max(max)
+  { }
+
+  Rect Expand(float amount) const
+  {
+    return Rect(min - Vec<2u>(amount, amount), max + Vec<2u>(amount, amount));
+  }
+
+  bool operator==(const Rect& other) const
+  {
+    return min == other.min && max == other.max;
+  }
+
+  bool Contains(const Vec<2u>& point) const
+  {
+    return point.x() >= min.x() && point.x() <= max.x() &&
+           point.y() >= min.y() && point.y() <= max.y();
+  }
+
+  Vec<2u> min;
+  Vec<2u> max;
+};
+
+/*
+ * This is the full-precision vertex, which meshes are processed in. It's also laid out the same as
+ * `VERTEX_FORMAT_FLOAT`, so can be uploaded as-is, but most meshes are packed into a smaller format when
+ * they're cooked (see asset.hpp).
+ */
 struct Vertex
 {
   Vertex() = default;
-  Vertex(const Vec<3u>& position, const Vec<2u>& texCoord)
+  Vertex(const Vec<3u>& position, const Vec<2u>& texCoord, const Vec<3u>& normal, const Vec<4u>& tangent)
     :position(position)
     ,texCoord(texCoord)
+    ,normal(normal)
+    ,tangent(tangent)
   { }
 
   Vec<3u> position;
   Vec<2u> texCoord;
+  Vec<3u> normal;
+  Vec<4u> tangent;    // NOTE(Isaac): `w` is the handedness of the bitangent (+1 or -1)
 };
 
 struct Transform
@@ -12,6 +12,15 @@
 #include <cstdlib>
 #include <csignal>
 #include <cinttypes>
+#include <cerrno>
+#include <vector>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
 #include <SDL2/SDL.h>
 #include <gl3w.hpp>
 #include <maths.hpp>
@@ -37,6 +46,7 @@ void DestroyPlatform()
 bool    g_keys[NUM_KEYBOARD_KEYS]         = {};
 bool    g_mouseButtons[NUM_MOUSE_BUTTONS] = {};
 Vec<2u> g_mousePosition                   = Vec<2u>(0.0f, 0.0f);
+int     g_mouseScroll                     = 0;
 
 void InitPlatform(unsigned int width, unsigned int height, bool fullscreen, const char* windowTitle)
 {
@@ -66,7 +76,7 @@ void InitPlatform(unsigned int width, unsigned int height, bool fullscreen, cons
 
   SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
   SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
-  SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 2);
+  SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3);
 
   g_window = SDL_CreateWindow(windowTitle,
                               SDL_WINDOWPOS_CENTERED,
@@ -90,6 +100,67 @@ void InitPlatform(unsigned int width, unsigned int height, bool fullscreen, cons
   ImGui_ImplSdlGL3_Init(g_window);
 }
 
+struct SharedGLContext
+{
+  SDL_Window*   window;
+  SDL_GLContext context;
+};
+
+SharedGLContext* CreateSharedGLContext()
+{
+  /*
+   * The context needs a drawable to be current on, and it isn't safe to share the main window across threads,
+   * so it gets its own hidden one.
+   */
+  SDL_GL_SetAttribute(SDL_GL_SHARE_WITH_CURRENT_CONTEXT, 1);
+  SDL_Window* window = SDL_CreateWindow("", 0, 0, 1, 1, SDL_WINDOW_OPENGL | SDL_WINDOW_HIDDEN);
+  SDL_GLContext context = (window ? SDL_GL_CreateContext(window) : nullptr);
+  SDL_GL_SetAttribute(SDL_GL_SHARE_WITH_CURRENT_CONTEXT, 0);
+
+  // NOTE(Isaac): creating a context makes it current, so we need to switch back to the main one
+  SDL_GL_MakeCurrent(g_window, g_context);
+
+  if (!context)
+  {
+    if (window)
+    {
+      SDL_DestroyWindow(window);
+    }
+
+    fprintf(stderr, "Failed to create shared GL context: %s\n", SDL_GetError());
+    return nullptr;
+  }
+
+  SharedGLContext* shared = new SharedGLContext;
+  shared->window = window;
+  shared->context = context;
+  return shared;
+}
+
+void MakeSharedGLContextCurrent(SharedGLContext* context)
+{
+  if (context)
+  {
+    SDL_GL_MakeCurrent(context->window, context->context);
+  }
+  else
+  {
+    SDL_GL_MakeCurrent(nullptr, nullptr);
+  }
+}
+
+void DestroySharedGLContext(SharedGLContext* context)
+{
+  if (!context)
+  {
+    return;
+  }
+
+  SDL_GL_DeleteContext(context->context);
+  SDL_DestroyWindow(context->window);
+  delete context;
+}
+
 // Utility functions
 void itoa(char* buffer, unsigned long int n, int base)
 {
@@ -114,37 +185,374 @@ void itoa(char* buffer, unsigned long int n, int base)
   }
 }
 
-char* LoadFileAsString(const char* path)
+const char* GetFileErrorString(FileError error)
 {
-  FILE* file = fopen(path, "rb");
+  switch (error)
+  {
+    case FILE_OK:               return "no error";
+    case FILE_NOT_FOUND:        return "file not found";
+    case FILE_ACCESS_DENIED:    return "access denied";
+    case FILE_UNREADABLE:       return "couldn't be read";
+    case FILE_CORRUPT:          return "corrupt";
+    case FILE_OUT_OF_MEMORY:    return "out of memory";
+  }
 
-  if (!file)
+  return "unknown error";
+}
+
+static FileError GetOpenError()
+{
+  switch (errno)
   {
-    fprintf(stderr, "Failed to read source file: %s\n", path);
-    exit(1);
+    case ENOENT:
+    case ENOTDIR:   return FILE_NOT_FOUND;
+    case EACCES:
+    case EPERM:     return FILE_ACCESS_DENIED;
+    default:        return FILE_UNREADABLE;
   }
+}
 
-  fseek(file, 0, SEEK_END);
-  unsigned long length = ftell(file);
-  fseek(file, 0, SEEK_SET);
-  char* contents = static_cast<char*>(malloc(length + 1));
+FileError MapFile(const char* path, MappedFile& file)
+{
+  file.data = nullptr;
+  file.size = 0u;
 
-  if (!contents)
+  int fd = open(path, O_RDONLY);
+
+  if (fd == -1)
   {
-    fprintf(stderr, "Failed to allocate space for source file!\n");
-    exit(1);
+    return GetOpenError();
   }
 
-  if (fread(contents, 1, length, file) != length)
+  struct stat info;
+  if (fstat(fd, &info) == -1)
   {
-    fprintf(stderr, "Failed to read source file: %s\n", path);
-    exit(1);
+    close(fd);
+    return FILE_UNREADABLE;
+  }
+
+  // NOTE(Isaac): we can't map nothing, but an empty file isn't an error, so it just has no data
+  if (info.st_size == 0)
+  {
+    close(fd);
+    return FILE_OK;
+  }
+
+  // NOTE(Isaac): the mapping keeps its own reference to the file, so we can close it straight away
+  void* data = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+
+  if (data == MAP_FAILED)
+  {
+    return FILE_UNREADABLE;
   }
 
-  contents[length] = '\0';
-  fclose(file);
+  file.data = data;
+  file.size = static_cast<size_t>(info.st_size);
+  return FILE_OK;
+}
+
+void UnmapFile(MappedFile& file)
+{
+  if (file.data)
+  {
+    munmap(const_cast<void*>(file.data), file.size);
+  }
+
+  file.data = nullptr;
+  file.size = 0u;
+}
+
+// --- Batched reads ---
+/*
+ * We talk to io_uring through the raw system calls, rather than pulling in liburing for the one thing we use
+ * it for. The rings are shared with the kernel, so the indices it writes have to be read with acquire
+ * semantics, and the ones we write have to be written with release semantics.
+ */
+#define IO_RING_ENTRIES 64u
+
+struct IoRing
+{
+  int             fd;
+  unsigned int    numEntries;
+  void*           sqRing;
+  size_t          sqRingSize;
+  void*           cqRing;
+  size_t          cqRingSize;
+  io_uring_sqe*   sqes;
+  size_t          sqesSize;
+
+  unsigned int*   sqTail;
+  unsigned int*   sqMask;
+  unsigned int*   sqArray;
+  unsigned int*   cqHead;
+  unsigned int*   cqTail;
+  unsigned int*   cqMask;
+  io_uring_cqe*   cqes;
+};
+
+static void DestroyIoRing(IoRing& ring)
+{
+  if (ring.sqes && ring.sqes != MAP_FAILED)
+  {
+    munmap(ring.sqes, ring.sqesSize);
+  }
+
+  if (ring.cqRing && ring.cqRing != MAP_FAILED && ring.cqRing != ring.sqRing)
+  {
+    munmap(ring.cqRing, ring.cqRingSize);
+  }
+
+  if (ring.sqRing && ring.sqRing != MAP_FAILED)
+  {
+    munmap(ring.sqRing, ring.sqRingSize);
+  }
 
-  return contents;
+  close(ring.fd);
+}
+
+/*
+ * NOTE(Isaac): this can fail even on kernels that have io_uring, because it's often blocked in containers, so
+ * callers always need a fallback.
+ */
+static bool CreateIoRing(IoRing& ring, unsigned int numEntries)
+{
+  io_uring_params params;
+  memset(&params, 0, sizeof(io_uring_params));
+  memset(&ring, 0, sizeof(IoRing));
+
+  ring.fd = static_cast<int>(syscall(__NR_io_uring_setup, numEntries, &params));
+
+  if (ring.fd < 0)
+  {
+    return false;
+  }
+
+  ring.numEntries = params.sq_entries;
+  ring.sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+  ring.cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  ring.sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+
+  // NOTE(Isaac): newer kernels let both rings share one mapping
+  bool singleMapping = (params.features & IORING_FEAT_SINGLE_MMAP);
+
+  if (singleMapping)
+  {
+    ring.sqRingSize = std::max(ring.sqRingSize, ring.cqRingSize);
+    ring.cqRingSize = ring.sqRingSize;
+  }
+
+  ring.sqRing = mmap(nullptr, ring.sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring.fd,
+                     IORING_OFF_SQ_RING);
+  ring.cqRing = singleMapping ? ring.sqRing : mmap(nullptr, ring.cqRingSize, PROT_READ | PROT_WRITE,
+                                                   MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_CQ_RING);
+  ring.sqes = static_cast<io_uring_sqe*>(mmap(nullptr, ring.sqesSize, PROT_READ | PROT_WRITE,
+                                              MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQES));
+
+  if (ring.sqRing == MAP_FAILED || ring.cqRing == MAP_FAILED || ring.sqes == MAP_FAILED)
+  {
+    DestroyIoRing(ring);
+    return false;
+  }
+
+  uint8_t* sq = static_cast<uint8_t*>(ring.sqRing);
+  uint8_t* cq = static_cast<uint8_t*>(ring.cqRing);
+  ring.sqTail   = reinterpret_cast<unsigned int*>(sq + params.sq_off.tail);
+  ring.sqMask   = reinterpret_cast<unsigned int*>(sq + params.sq_off.ring_mask);
+  ring.sqArray  = reinterpret_cast<unsigned int*>(sq + params.sq_off.array);
+  ring.cqHead   = reinterpret_cast<unsigned int*>(cq + params.cq_off.head);
+  ring.cqTail   = reinterpret_cast<unsigned int*>(cq + params.cq_off.tail);
+  ring.cqMask   = reinterpret_cast<unsigned int*>(cq + params.cq_off.ring_mask);
+  ring.cqes     = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+  return true;
+}
+
+/*
+ * Queues a read of every file that's been opened, in batches of however many the ring can hold, and records how
+ * much of each one was read. Anything it doesn't manage to read (because the kernel doesn't support
+ * `IORING_OP_READ`, or a read came up short) is left for the caller to finish off.
+ */
+static void SubmitReads(IoRing& ring, FileRead* reads, const int* fds, size_t* bytesRead, unsigned int count)
+{
+  unsigned int next = 0u;
+
+  while (next < count)
+  {
+    unsigned int tail = *(ring.sqTail);   // NOTE(Isaac): only we write this, so it doesn't need to be atomic
+    unsigned int numQueued = 0u;
+
+    while (next < count && numQueued < ring.numEntries)
+    {
+      if (fds[next] != -1 && reads[next].size > 0u)
+      {
+        unsigned int index = tail & *(ring.sqMask);
+        io_uring_sqe& sqe = ring.sqes[index];
+        memset(&sqe, 0, sizeof(io_uring_sqe));
+        sqe.opcode    = IORING_OP_READ;
+        sqe.fd        = fds[next];
+        sqe.addr      = reinterpret_cast<uint64_t>(reads[next].data);
+        sqe.len       = static_cast<uint32_t>(std::min<size_t>(reads[next].size, UINT32_MAX));
+        sqe.off       = 0u;
+        sqe.user_data = next;
+
+        ring.sqArray[index] = index;
+        tail++;
+        numQueued++;
+      }
+
+      next++;
+    }
+
+    if (numQueued == 0u)
+    {
+      return;
+    }
+
+    __atomic_store_n(ring.sqTail, tail, __ATOMIC_RELEASE);
+    long numSubmitted = syscall(__NR_io_uring_enter, ring.fd, numQueued, numQueued, IORING_ENTER_GETEVENTS,
+                                nullptr, 0);
+
+    if (numSubmitted <= 0)
+    {
+      return;
+    }
+
+    unsigned int head = *(ring.cqHead);
+
+    for (long numReaped = 0;
+         numReaped < numSubmitted;)
+    {
+      if (head == __atomic_load_n(ring.cqTail, __ATOMIC_ACQUIRE))
+      {
+        syscall(__NR_io_uring_enter, ring.fd, 0u, 1u, IORING_ENTER_GETEVENTS, nullptr, 0);
+        continue;
+      }
+
+      const io_uring_cqe& cqe = ring.cqes[head & *(ring.cqMask)];
+
+      if (cqe.res > 0)
+      {
+        bytesRead[cqe.user_data] = static_cast<size_t>(cqe.res);
+      }
+
+      head++;
+      numReaped++;
+    }
+
+    __atomic_store_n(ring.cqHead, head, __ATOMIC_RELEASE);
+
+    // NOTE(Isaac): if the kernel didn't take everything, the ring's in a weird state, so we give up on it
+    if (numSubmitted < static_cast<long>(numQueued))
+    {
+      return;
+    }
+  }
+}
+
+void ReadFiles(FileRead* reads, unsigned int count)
+{
+  std::vector<int> fds(count, -1);
+  std::vector<size_t> bytesRead(count, 0u);
+
+  for (unsigned int i = 0u;
+       i < count;
+       i++)
+  {
+    FileRead& read = reads[i];
+    read.data = nullptr;
+    read.size = 0u;
+    read.error = FILE_OK;
+
+    int fd = open(read.path, O_RDONLY);
+
+    if (fd == -1)
+    {
+      read.error = GetOpenError();
+      continue;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) == -1)
+    {
+      read.error = FILE_UNREADABLE;
+      close(fd);
+      continue;
+    }
+
+    // NOTE(Isaac): always allocate something, so empty files still have some data to free
+    read.size = static_cast<size_t>(info.st_size);
+    read.data = static_cast<uint8_t*>(malloc(std::max<size_t>(read.size, 1u)));
+
+    if (!read.data)
+    {
+      read.size = 0u;
+      read.error = FILE_OUT_OF_MEMORY;
+      close(fd);
+      continue;
+    }
+
+    fds[i] = fd;
+  }
+
+  IoRing ring;
+
+  if (CreateIoRing(ring, IO_RING_ENTRIES))
+  {
+    SubmitReads(ring, reads, fds.data(), bytesRead.data(), count);
+    DestroyIoRing(ring);
+  }
+
+  // Finish off anything io_uring didn't read for us
+  for (unsigned int i = 0u;
+       i < count;
+       i++)
+  {
+    FileRead& read = reads[i];
+
+    if (fds[i] == -1)
+    {
+      continue;
+    }
+
+    while (bytesRead[i] < read.size)
+    {
+      ssize_t result = pread(fds[i], read.data + bytesRead[i], read.size - bytesRead[i], bytesRead[i]);
+
+      if (result <= 0)
+      {
+        read.error = FILE_UNREADABLE;
+        free(read.data);
+        read.data = nullptr;
+        read.size = 0u;
+        break;
+      }
+
+      bytesRead[i] += static_cast<size_t>(result);
+    }
+
+    close(fds[i]);
+  }
+}
+
+/*
+ * Mapping a file doesn't actually read any of it - each page is only read from disk the first time it's
+ * touched. This touches all of the pages in a range of a mapping, so whoever reads it next doesn't have to
+ * wait on the disk.
+ */
+void PageIn(const void* data, size_t size)
+{
+  const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  uintptr_t pageStart = reinterpret_cast<uintptr_t>(data) & ~(pageSize - 1u);
+  madvise(reinterpret_cast<void*>(pageStart), reinterpret_cast<uintptr_t>(data) + size - pageStart, MADV_WILLNEED);
+
+  const volatile uint8_t* bytes = static_cast<const volatile uint8_t*>(data);
+
+  for (size_t i = 0u;
+       i < size;
+       i += pageSize)
+  {
+    (void)bytes[i];
+  }
 }
 
 const char* GetButtonName(ControllerButton button)
@@ -193,12 +601,16 @@ const char* GetAxisName(ControllerAxis axis)
 }
 
 // Platform stuff
-void PollWindowEvents(Controller& controller)
+bool PollWindowEvents(Controller& controller)
 {
+  g_mouseScroll = 0;
+  bool hadEvents = false;
+
   SDL_Event event;
   while (SDL_PollEvent(&event))
   {
     ImGui_ImplSdlGL3_ProcessEvent(&event);
+    hadEvents = true;
 
     switch (event.type)
     {
@@ -232,6 +644,11 @@ void PollWindowEvents(Controller& controller)
         g_mouseButtons[event.button.button] = false;
       } break;
 
+      case SDL_MOUSEWHEEL:
+      {
+        g_mouseScroll += event.wheel.y;
+      } break;
+
       case SDL_CONTROLLERDEVICEADDED:
       {
         int id = event.cdevice.which;
@@ -304,6 +721,17 @@ void PollWindowEvents(Controller& controller)
       } break;
     }
   }
+
+  return hadEvents;
+}
+
+/*
+ * Blocks until there's an event to handle, or until the timeout runs out. The event is left in the queue for
+ * `PollWindowEvents` to deal with.
+ */
+void WaitForWindowEvents(unsigned int timeout)
+{
+  SDL_WaitEventTimeout(nullptr, static_cast<int>(timeout));
 }
 
 void RumbleController(float strength, unsigned int length)
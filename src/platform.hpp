@@ -316,6 +316,7 @@ enum KeyboardKeys
 extern bool     g_keys[NUM_KEYBOARD_KEYS];
 extern bool     g_mouseButtons[NUM_MOUSE_BUTTONS];
 extern Vec<2u>  g_mousePosition;  // NOTE(Isaac): Relative to top-left of window
+extern int      g_mouseScroll;    // NOTE(Isaac): Wheel clicks since the last poll (positive is away from the user)
 
 struct Controller
 {
@@ -337,14 +338,70 @@ struct TermHandle
 
 // Utility functions
 void itoa(char* buffer, unsigned long int n, int base);
-char* LoadFileAsString(const char* path);
+
+/*
+ * File functions don't print anything or give up when something goes wrong - they just say what happened, and
+ * leave it up to the caller.
+ */
+enum FileError
+{
+  FILE_OK,
+  FILE_NOT_FOUND,
+  FILE_ACCESS_DENIED,
+  FILE_UNREADABLE,
+  FILE_CORRUPT,
+  FILE_OUT_OF_MEMORY,
+};
+
+const char* GetFileErrorString(FileError error);
+
+/*
+ * A read-only view of a whole file, mapped into memory. Nothing is actually read until it's touched, and the
+ * pages come straight from the page cache, so this is much cheaper than reading the file into a buffer.
+ */
+struct MappedFile
+{
+  const void* data;
+  size_t      size;
+};
+
+FileError MapFile(const char* path, MappedFile& file);
+void UnmapFile(MappedFile& file);
+
+/*
+ * Reads a batch of whole files into memory, and blocks until all of them have been read. Every read is queued
+ * with the kernel at once (through io_uring, if it's available), so the disk can be kept busy with all of them,
+ * rather than waiting on each file in turn - but it's not asynchronous, so it shouldn't be called from the main
+ * thread for anything big. This is worth it for lots of small files, which cost more to map than to copy.
+ */
+struct FileRead
+{
+  const char* path;
+  uint8_t*    data;     // NOTE(Isaac): allocated with `malloc`, and owned by the caller afterwards
+  size_t      size;
+  FileError   error;
+};
+
+void ReadFiles(FileRead* reads, unsigned int count);
+void PageIn(const void* data, size_t size);   // NOTE(Isaac): blocks until all of the range has been read in
 const char* GetButtonName(ControllerButton button);
 const char* GetAxisName(ControllerAxis axis);
 
 // Platform management
 void InitPlatform(unsigned int width, unsigned int height, bool fullscreen, const char* windowTitle);
-void PollWindowEvents(Controller& controller);
+bool PollWindowEvents(Controller& controller);   // NOTE(Isaac): returns whether there were any events
+void WaitForWindowEvents(unsigned int timeout);  // NOTE(Isaac): in milliseconds
 void PrepareFrame();
 void SwapWindowBuffer();
 void RumbleController(float strength, unsigned int length);
+
+/*
+ * A GL context that shares objects (programs, buffers, textures etc.) with the main one, so a worker thread can
+ * create them in the background. It has to be created on the main thread, but can then be made current on a
+ * single worker thread. Returns nullptr if the platform can't give us one.
+ */
+struct SharedGLContext;
+SharedGLContext* CreateSharedGLContext();
+void MakeSharedGLContextCurrent(SharedGLContext* context);
+void DestroySharedGLContext(SharedGLContext* context);
 void DestroyPlatform();
@@ -5,214 +5,1959 @@
 
 #include <rendering.hpp>
 #include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <sys/stat.h>
 #include <platform.hpp>
 #include <gl3w.hpp>
 #include <imgui/imgui.hpp>
+#include <jobs.hpp>
 
-#define STB_IMAGE_IMPLEMENTATION
-#include <stb_image.hpp>
+// --- Meshes ---
+/*
+ * Points each attribute of the currently-bound VAO at the right part of the currently-bound vertex buffer.
+ */
+static void SetVertexFormat(const VertexFormat& format)
+{
+  for (unsigned int i = 0u;
+       i < NUM_VERTEX_ATTRIBUTES;
+       i++)
+  {
+    const VertexAttribute& attribute = format.attributes[i];
+    GLenum type = GL_FLOAT;
+    GLboolean normalised = GL_FALSE;
+
+    switch (attribute.type)
+    {
+      case ATTRIBUTE_FLOAT:   type = GL_FLOAT;                                break;
+      case ATTRIBUTE_HALF:    type = GL_HALF_FLOAT;                           break;
+      case ATTRIBUTE_UNORM16: type = GL_UNSIGNED_SHORT; normalised = GL_TRUE; break;
+      case ATTRIBUTE_SNORM16: type = GL_SHORT;          normalised = GL_TRUE; break;
+    }
+
+    glEnableVertexAttribArray(i);
+    glVertexAttribPointer(i, attribute.components, type, normalised, format.stride, (const void*)(uintptr_t)attribute.offset);
+  }
+}
+
+static void CreateMeshBuffers(Mesh& mesh, VertexFormatType format, const void* vertices, unsigned int numVertices,
+                              const void* indices, unsigned int indexSize, unsigned int numIndices)
+{
+  mesh.numElements = numIndices;
+  mesh.format = format;
+  mesh.indexType = (indexSize == sizeof(uint16_t)) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+
+  glGenVertexArrays(1, &(mesh.vao));
+  glBindVertexArray(mesh.vao);
+
+  glGenBuffers(1, &(mesh.vbo));
+  glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo);
+  glBufferData(GL_ARRAY_BUFFER, numVertices * GetVertexFormat(format).stride, vertices, GL_STATIC_DRAW);
+  SetVertexFormat(GetVertexFormat(format));
+
+  glGenBuffers(1, &(mesh.ebo));
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.ebo);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, numIndices * indexSize, indices, GL_STATIC_DRAW);
+
+  glBindVertexArray(0);
+}
+
+Mesh::Mesh()
+  :numElements(0u)
+  ,boundingRadius(0.0f)
+  ,format(VERTEX_FORMAT_FLOAT)
+  ,indexType(GL_UNSIGNED_INT)
+  ,dequantisationScale(1.0f, 1.0f, 1.0f)
+  ,dequantisationOffset(0.0f, 0.0f, 0.0f)
+  ,submeshes()
+  ,vao(0u)
+  ,vbo(0u)
+  ,ebo(0u)
+  ,loaded(false)
+{
+}
+
+Mesh::Mesh(const MeshData& meshData)
+  :boundingRadius(0.0f)
+  ,dequantisationScale(1.0f, 1.0f, 1.0f)
+  ,dequantisationOffset(0.0f, 0.0f, 0.0f)
+  ,loaded(true)
+{
+  for (unsigned int i = 0u;
+       i < meshData.numVertices;
+       i++)
+  {
+    boundingRadius = std::max(boundingRadius, Length(meshData.vertices[i].position));
+  }
+
+  CreateMeshBuffers(*this, VERTEX_FORMAT_FLOAT, meshData.vertices, meshData.numVertices,
+                    meshData.indices, sizeof(unsigned int), meshData.numIndices);
+
+  submeshes = meshData.submeshes;
+  if (submeshes.empty())
+  {
+    submeshes.push_back(Submesh{0u, meshData.numIndices, 0u});
+  }
+}
+
+/*
+ * Checks that a mapped file is a cooked mesh that's safe to read from, and returns its header (or nullptr,
+ * after saying what's wrong with it). This is called by the job system, so it mustn't touch GL.
+ */
+static const CookedMeshHeader* ValidateCookedMesh(const FileView& file, const char* path)
+{
+  const CookedMeshHeader* header = static_cast<const CookedMeshHeader*>(file.data);
+
+  if (file.size < sizeof(CookedMeshHeader) || header->magic != COOKED_MESH_MAGIC)
+  {
+    fprintf(stderr, "Not a cooked mesh: %s\n", path);
+    return nullptr;
+  }
+
+  if (header->version != COOKED_MESH_VERSION ||
+      header->vertexFormat >= NUM_VERTEX_FORMATS ||
+      header->vertexStride != GetVertexFormat(header->vertexFormat).stride)
+  {
+    fprintf(stderr, "Cooked mesh is out of date (version %u), it needs recooking: %s\n", header->version, path);
+    return nullptr;
+  }
+
+  if (header->vertexOffset + static_cast<size_t>(header->numVertices) * header->vertexStride > file.size ||
+      header->indexOffset + static_cast<size_t>(header->numIndices) * header->indexSize > file.size ||
+      header->submeshOffset + static_cast<size_t>(header->numSubmeshes) * sizeof(Submesh) > file.size)
+  {
+    fprintf(stderr, "Cooked mesh is truncated: %s\n", path);
+    return nullptr;
+  }
+
+  return header;
+}
+
+/*
+ * The vertices and indices are handed to the driver straight out of the file's view (which is usually a
+ * mapping), so they're never copied on our side.
+ */
+static void CreateCookedMesh(Mesh& mesh, const CookedMeshHeader* header)
+{
+  const uint8_t* bytes = reinterpret_cast<const uint8_t*>(header);
+
+  mesh.boundingRadius = header->boundingRadius;
+  mesh.dequantisationScale = Vec<3u>(header->dequantisationScale[0u],
+                                     header->dequantisationScale[1u],
+                                     header->dequantisationScale[2u]);
+  mesh.dequantisationOffset = Vec<3u>(header->dequantisationOffset[0u],
+                                      header->dequantisationOffset[1u],
+                                      header->dequantisationOffset[2u]);
+
+  CreateMeshBuffers(mesh, header->vertexFormat, bytes + header->vertexOffset, header->numVertices,
+                    bytes + header->indexOffset, header->indexSize, header->numIndices);
+
+  const Submesh* fileSubmeshes = reinterpret_cast<const Submesh*>(bytes + header->submeshOffset);
+  mesh.submeshes.assign(fileSubmeshes, fileSubmeshes + header->numSubmeshes);
+  mesh.loaded = true;
+}
+
+/*
+ * Loads a mesh that's been cooked by `tools/cooker`.
+ */
+Mesh::Mesh(const char* cookedPath)
+  :loaded(false)
+{
+  FileView file;
+  FileError error = OpenFile(cookedPath, file);
+
+  if (error != FILE_OK)
+  {
+    fprintf(stderr, "FATAL: Failed to open mesh: %s (%s)\n", cookedPath, GetFileErrorString(error));
+    exit(1);
+  }
+
+  const CookedMeshHeader* header = ValidateCookedMesh(file, cookedPath);
+
+  if (!header)
+  {
+    exit(1);
+  }
+
+  CreateCookedMesh(*this, header);
+}
+
+Mesh::~Mesh()
+{
+  glDeleteBuffers(1, &(this->vbo));
+  glDeleteBuffers(1, &(this->ebo));
+  glDeleteVertexArrays(1, &(this->vao));
+}
+
+void DrawMesh(Mesh& mesh)
+{
+  glBindVertexArray(mesh.vao);
+  glDrawElements(GL_TRIANGLES, mesh.numElements, mesh.indexType, 0);
+}
+
+// --- Shaders ---
+enum ShaderPart
+{
+  VERTEX,
+  FRAGMENT,
+};
+
+// NOTE(Isaac): `KHR_parallel_shader_compile` is too new to be in our glcorearb.h
+#define GL_MAX_SHADER_COMPILER_THREADS_KHR  0x91B0
+#define GL_COMPLETION_STATUS_KHR            0x91B1
+typedef void (APIENTRYP PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)(GLuint count);
+
+/*
+ * A shader's source, as the pieces that get handed to GL: everything up to and including the `#version` line,
+ * the defines, and then the rest. The file is never copied - GL is happy to stitch the pieces back together
+ * itself.
+ */
+struct ShaderSource
+{
+  FileView      file;
+  const char*   pieces[3u];
+  GLint         lengths[3u];
+};
+
+/*
+ * Defines have to come after the `#version` directive, so we can't just stick them on the front.
+ */
+static void SplitShaderSource(ShaderSource& source, const std::string& defines)
+{
+  const char* text = reinterpret_cast<const char*>(source.file.data);
+  const char* end = text + source.file.size;
+  const char* version = "#version";
+  const char* split = std::search(text, end, version, version + strlen(version));
+
+  if (split != end)
+  {
+    split = std::find(split, end, '\n');
+    split = (split == end) ? end : split + 1u;
+  }
+  else
+  {
+    split = text;
+  }
+
+  // NOTE(Isaac): GL doesn't like null pointers, even with a length of zero
+  source.pieces[0u] = text ? text : "";
+  source.lengths[0u] = static_cast<GLint>(split - text);
+  source.pieces[1u] = defines.c_str();
+  source.lengths[1u] = static_cast<GLint>(defines.size());
+  source.pieces[2u] = text ? split : "";
+  source.lengths[2u] = static_cast<GLint>(end - split);
+}
+
+/*
+ * This only starts the compile - the status isn't checked until `CheckShaderPart`, so the driver is free to do
+ * the work in the background in the meantime.
+ */
+static GLuint CompileShaderPart(ShaderPart part, const ShaderSource& source)
+{
+  GLuint handle = 0;
+
+  switch (part)
+  {
+    case VERTEX:    handle = glCreateShader(GL_VERTEX_SHADER);    break;
+    case FRAGMENT:  handle = glCreateShader(GL_FRAGMENT_SHADER);  break;
+  }
+
+  glShaderSource(handle, 3, source.pieces, source.lengths);
+  glCompileShader(handle);
+  return handle;
+}
+
+static void CheckShaderPart(GLuint handle, const char* name)
+{
+  GLint success = GL_FALSE;
+  int messageLength;
+  glGetShaderiv(handle, GL_COMPILE_STATUS, &success);
+  glGetShaderiv(handle, GL_INFO_LOG_LENGTH, &messageLength);
+
+  if (!success)
+  {
+    char message[messageLength + 1u];
+    glGetShaderInfoLog(handle, messageLength, nullptr, message);
+    std::cerr << "Failed to compile shader (" << name << "): " << message << std::endl;
+  }
+}
+
+static void ReflectShader(Shader& shader)
+{
+  GLint numUniforms, numBlocks, maxNameLength, maxBlockNameLength;
+  glGetProgramiv(shader.handle, GL_ACTIVE_UNIFORMS, &numUniforms);
+  glGetProgramiv(shader.handle, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+  glGetProgramiv(shader.handle, GL_ACTIVE_UNIFORM_BLOCKS, &numBlocks);
+  glGetProgramiv(shader.handle, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &maxBlockNameLength);
+
+  char name[std::max(maxNameLength, maxBlockNameLength) + 1];
+
+  for (GLint i = 0;
+       i < numUniforms;
+       i++)
+  {
+    GLint size;
+    GLenum type;
+    glGetActiveUniform(shader.handle, i, sizeof(name), nullptr, &size, &type, name);
+
+    // NOTE(Isaac): uniforms in blocks don't have a location, so we can skip them
+    GLint location = glGetUniformLocation(shader.handle, name);
+    if (location == -1)
+    {
+      continue;
+    }
+
+    // Arrays are reported as "name[0]", but we want to be able to look them up with just "name"
+    char* subscript = strchr(name, '[');
+    if (subscript)
+    {
+      *subscript = '\0';
+    }
+
+    shader.uniforms[name] = location;
+  }
+
+  for (GLint i = 0;
+       i < numBlocks;
+       i++)
+  {
+    glGetActiveUniformBlockName(shader.handle, i, sizeof(name), nullptr, name);
+    shader.uniformBlocks[name] = static_cast<GLuint>(i);
+  }
+}
+
+// --- Program binary cache ---
+#define SHADER_CACHE_DIRECTORY  "./cache/shaders"
+#define SHADER_CACHE_MAGIC      0x53484452u   // NOTE(Isaac): "SHDR"
+
+/*
+ * This is the header at the start of each cached program binary. The binary itself follows straight after it.
+ */
+struct ShaderCacheHeader
+{
+  uint32_t  magic;
+  uint32_t  format;
+  uint32_t  length;
+};
+
+/*
+ * 64-bit FNV-1a. Used to key the cache, so it doesn't need to be fancy, just cheap and well-distributed.
+ */
+static uint64_t HashString(uint64_t hash, const char* str)
+{
+  for (const char* c = str;
+       *c;
+       c++)
+  {
+    hash ^= static_cast<uint8_t>(*c);
+    hash *= 0x100000001b3ull;
+  }
+
+  return hash;
+}
+
+static uint64_t HashBytes(uint64_t hash, const char* data, size_t length)
+{
+  for (size_t i = 0u;
+       i < length;
+       i++)
+  {
+    hash ^= static_cast<uint8_t>(data[i]);
+    hash *= 0x100000001b3ull;
+  }
+
+  return hash;
+}
+
+static uint64_t HashShaderSource(uint64_t hash, const ShaderSource& source)
+{
+  for (unsigned int i = 0u;
+       i < 3u;
+       i++)
+  {
+    hash = HashBytes(hash, source.pieces[i], static_cast<size_t>(source.lengths[i]));
+  }
+
+  return hash;
+}
+
+/*
+ * Cached binaries are only valid for the exact driver that produced them, so the renderer, version and vendor
+ * strings are part of the key as well as the sources. If any of them change, we just miss the cache and
+ * compile from source again.
+ */
+static uint64_t GetShaderCacheKey(const ShaderSource& vertexSource, const ShaderSource& fragmentSource)
+{
+  uint64_t hash = 0xcbf29ce484222325ull;
+  hash = HashShaderSource(hash, vertexSource);
+  hash = HashShaderSource(hash, fragmentSource);
+  hash = HashString(hash, reinterpret_cast<const char*>(glGetString(GL_VENDOR)));
+  hash = HashString(hash, reinterpret_cast<const char*>(glGetString(GL_RENDERER)));
+  hash = HashString(hash, reinterpret_cast<const char*>(glGetString(GL_VERSION)));
+  return hash;
+}
+
+static void GetShaderCachePath(char* path, size_t length, uint64_t key)
+{
+  snprintf(path, length, SHADER_CACHE_DIRECTORY "/%016llx.bin", static_cast<unsigned long long>(key));
+}
+
+static bool SupportsProgramBinaries()
+{
+  GLint numFormats = 0;
+  glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats);
+  return (numFormats > 0);
+}
+
+/*
+ * Tries to restore a program from the cache. Returns false if there's no cached binary, or if the driver
+ * rejects it (which it's allowed to do at any time, e.g. after an update), in which case the program should be
+ * built from source instead.
+ */
+static bool LoadCachedProgram(GLuint program, const char* path)
+{
+  FILE* file = fopen(path, "rb");
+
+  if (!file)
+  {
+    return false;
+  }
+
+  ShaderCacheHeader header;
+  if (fread(&header, sizeof(ShaderCacheHeader), 1, file) != 1 || header.magic != SHADER_CACHE_MAGIC)
+  {
+    fclose(file);
+    return false;
+  }
+
+  void* binary = malloc(header.length);
+  bool readBinary = (fread(binary, 1, header.length, file) == header.length);
+  fclose(file);
+
+  if (!readBinary)
+  {
+    free(binary);
+    return false;
+  }
+
+  glProgramBinary(program, static_cast<GLenum>(header.format), binary, static_cast<GLsizei>(header.length));
+  free(binary);
+
+  GLint success = GL_FALSE;
+  glGetProgramiv(program, GL_LINK_STATUS, &success);
+  return (success == GL_TRUE);
+}
+
+static void StoreCachedProgram(GLuint program, const char* path)
+{
+  GLint length = 0;
+  glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+
+  if (length <= 0)
+  {
+    return;
+  }
+
+  ShaderCacheHeader header;
+  header.magic = SHADER_CACHE_MAGIC;
+  void* binary = malloc(length);
+  GLenum format;
+  glGetProgramBinary(program, length, nullptr, &format, binary);
+  header.format = static_cast<uint32_t>(format);
+  header.length = static_cast<uint32_t>(length);
+
+  // NOTE(Isaac): it doesn't matter if these already exist
+  mkdir("./cache", 0755);
+  mkdir(SHADER_CACHE_DIRECTORY, 0755);
+
+  FILE* file = fopen(path, "wb");
+
+  if (!file)
+  {
+    std::cerr << "Failed to write shader cache entry: " << path << std::endl;
+    free(binary);
+    return;
+  }
+
+  fwrite(&header, sizeof(ShaderCacheHeader), 1, file);
+  fwrite(binary, 1, length, file);
+  fclose(file);
+  free(binary);
+}
+
+// --- Shader builds ---
+/*
+ * Everything needed to build one shader program. Sources are loaded and preprocessed on the main thread, but
+ * the rest can happen wherever the `ShaderCompiler` decides.
+ */
+struct ShaderBuild
+{
+  Shader*       shader;
+  std::string   name;           // NOTE(Isaac): only for error messages
+  std::string   defines;        // NOTE(Isaac): the sources point into this, so it has to live as long as they do
+  ShaderSource  vertexSource;
+  ShaderSource  fragmentSource;
+  bool          useCache;
+  char          cachePath[256u];
+  GLuint        vertex;
+  GLuint        fragment;
+  std::chrono::high_resolution_clock::time_point startTime;
+};
+
+static ShaderBuild* PrepareBuild(Shader* shader, const std::string& basePath, const std::string& defines)
+{
+  ShaderBuild* build = new ShaderBuild;
+  build->shader = shader;
+  build->name = basePath;
+  build->vertex = 0u;
+  build->fragment = 0u;
+  build->startTime = std::chrono::high_resolution_clock::now();
+
+  build->defines = defines;
+
+  // Load both sources in one go - they're small, so this is just a single batch of reads
+  std::string vertexPath = basePath + ".vert";
+  std::string fragmentPath = basePath + ".frag";
+  const char* paths[2u] = {vertexPath.c_str(), fragmentPath.c_str()};
+  FileView views[2u];
+  FileError errors[2u];
+  OpenFiles(paths, 2u, views, errors);
+
+  // NOTE(Isaac): we carry on with an empty source, so the failure gets reported along with the compile errors
+  for (unsigned int i = 0u;
+       i < 2u;
+       i++)
+  {
+    if (errors[i] != FILE_OK)
+    {
+      std::cerr << "Failed to load shader source (" << paths[i] << "): " << GetFileErrorString(errors[i]) <<
+        std::endl;
+    }
+  }
+
+  build->vertexSource.file = std::move(views[0u]);
+  build->fragmentSource.file = std::move(views[1u]);
+  SplitShaderSource(build->vertexSource, build->defines);
+  SplitShaderSource(build->fragmentSource, build->defines);
+
+  // NOTE(Isaac): the defines are part of the sources, so each variant gets its own cache entry
+  build->useCache = SupportsProgramBinaries();
+  GetShaderCachePath(build->cachePath, sizeof(build->cachePath),
+                     GetShaderCacheKey(build->vertexSource, build->fragmentSource));
+
+  return build;
+}
+
+/*
+ * Creates the program, and either restores it from the cache or starts compiling and linking it. Doesn't wait
+ * for any of it to finish.
+ */
+static void BeginBuild(ShaderBuild& build)
+{
+  Shader& shader = *(build.shader);
+  shader.handle = glCreateProgram();
+
+  if (build.useCache)
+  {
+    shader.fromCache = LoadCachedProgram(shader.handle, build.cachePath);
+  }
+
+  if (shader.fromCache)
+  {
+    return;
+  }
+
+  build.vertex = CompileShaderPart(ShaderPart::VERTEX, build.vertexSource);
+  build.fragment = CompileShaderPart(ShaderPart::FRAGMENT, build.fragmentSource);
+
+  glAttachShader(shader.handle, build.vertex);
+  glAttachShader(shader.handle, build.fragment);
+
+  if (build.useCache)
+  {
+    glProgramParameteri(shader.handle, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+  }
+
+  glLinkProgram(shader.handle);
+}
+
+/*
+ * Waits for the program to link (if it hasn't already), reports any errors, and reflects it. The caller is
+ * responsible for setting `ready`.
+ */
+static void FinishBuild(ShaderBuild& build)
+{
+  Shader& shader = *(build.shader);
+
+  if (!shader.fromCache)
+  {
+    CheckShaderPart(build.vertex, (build.name + ".vert").c_str());
+    CheckShaderPart(build.fragment, (build.name + ".frag").c_str());
+
+    GLint success;
+    int messageLength;
+    glGetProgramiv(shader.handle, GL_LINK_STATUS, &success);
+    glGetProgramiv(shader.handle, GL_INFO_LOG_LENGTH, &messageLength);
+
+    if (!success)
+    {
+      char message[messageLength + 1u];
+      glGetProgramInfoLog(shader.handle, messageLength, nullptr, message);
+      std::cerr << "Failed to link shader program (" << build.name << "): " << message << std::endl;
+    }
+    else if (build.useCache)
+    {
+      StoreCachedProgram(shader.handle, build.cachePath);
+    }
+
+    glDetachShader(shader.handle, build.vertex);
+    glDetachShader(shader.handle, build.fragment);
+    glDeleteShader(build.vertex);
+    glDeleteShader(build.fragment);
+  }
+
+  // NOTE(Isaac): a restored program has the same interface, but we still need to reflect it
+  ReflectShader(shader);
+  BindUniformBlock(shader, "FrameUniforms", FRAME_UNIFORMS_BINDING);
+
+  shader.loadTime = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() -
+                                                             build.startTime).count();
+}
+
+Shader::Shader()
+  :handle(0u)
+  ,textureCount(0u)
+  ,loadTime(0.0f)
+  ,fromCache(false)
+  ,ready(false)
+  ,uniforms()
+  ,uniformBlocks()
+{
+}
+
+/*
+ * Vertex shader should be located at {basePath}.vert
+ * Fragment shader should be located at {basePath}.frag
+ *
+ * If we've linked the same sources with the same driver before, the linked program is restored from the binary
+ * cache rather than being compiled again.
+ */
+Shader::Shader(const char* basePath)
+  :Shader()
+{
+  ShaderBuild* build = PrepareBuild(this, basePath, "");
+  BeginBuild(*build);
+  FinishBuild(*build);
+  ready = true;
+  delete build;
+}
+
+Shader::~Shader()
+{
+  glDeleteProgram(this->handle);
+}
+
+void UseShader(Shader& shader)
+{
+  glUseProgram(shader.handle);
+  shader.textureCount = 0u;
+}
+
+GLint GetUniformLocation(const Shader& shader, const char* name)
+{
+  auto it = shader.uniforms.find(name);
+  return (it == shader.uniforms.end()) ? -1 : it->second;
+}
+
+void BindUniformBlock(Shader& shader, const char* name, GLuint bindingPoint)
+{
+  auto it = shader.uniformBlocks.find(name);
+
+  if (it != shader.uniformBlocks.end())
+  {
+    glUniformBlockBinding(shader.handle, it->second, bindingPoint);
+  }
+}
+
+template<>
+void SetUniform<Texture>(Shader& shader, GLint location, const Texture& value)
+{
+  glActiveTexture(GL_TEXTURE0 + shader.textureCount);
+  glBindTexture(GL_TEXTURE_2D, value.handle);
+  glUniform1i(location, shader.textureCount);
+  shader.textureCount++;
+}
+
+template<>
+void SetUniform<Vec<4u>>(Shader& /*shader*/, GLint location, const Vec<4u>& v)
+{
+  glUniform4f(location, v.x(), v.y(), v.z(), v.w());
+}
+
+template<>
+void SetUniform<Mat<4u>>(Shader& /*shader*/, GLint location, const Mat<4u>& mat)
+{
+  glUniformMatrix4fv(location, 1, GL_FALSE, &(mat[0u][0u]));
+}
+
+// --- Shader permutations ---
+ShaderPermutations::ShaderPermutations(const char* basePath, std::initializer_list<const char*> features)
+  :basePath(basePath)
+  ,features()
+  ,variants()
+{
+  for (const char* feature : features)
+  {
+    this->features.push_back(feature);
+  }
+
+  if (this->features.size() > MAX_SHADER_FEATURES)
+  {
+    fprintf(stderr, "FATAL: Shader '%s' has too many features!\n", basePath);
+    exit(1);
+  }
+}
+
+ShaderPermutations::~ShaderPermutations()
+{
+  for (auto& variant : variants)
+  {
+    delete variant.second;
+  }
+}
+
+ShaderFeatures GetShaderFeature(const ShaderPermutations& permutations, const char* name)
+{
+  for (unsigned int i = 0u;
+       i < permutations.features.size();
+       i++)
+  {
+    if (permutations.features[i] == name)
+    {
+      return (1u << i);
+    }
+  }
+
+  std::cerr << "Shader '" << permutations.basePath << "' doesn't have a feature called: " << name << std::endl;
+  return 0u;
+}
+
+// --- Shader compiler ---
+static bool HasExtension(const char* name)
+{
+  GLint numExtensions = 0;
+  glGetIntegerv(GL_NUM_EXTENSIONS, &numExtensions);
+
+  for (GLint i = 0;
+       i < numExtensions;
+       i++)
+  {
+    if (strcmp(reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i)), name) == 0)
+    {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+ShaderCompiler::ShaderCompiler()
+  :mode(MAIN_THREAD)
+  ,pending()
+  ,pendingLock()
+  ,pendingChanged()
+  ,worker()
+  ,quit(false)
+  ,workerContext(nullptr)
+{
+  /*
+   * The ARB version of the extension is the same thing, with the same enums, but a different suffix on the
+   * function name.
+   */
+  bool hasKHR = HasExtension("GL_KHR_parallel_shader_compile");
+
+  if (hasKHR || HasExtension("GL_ARB_parallel_shader_compile"))
+  {
+    auto maxCompilerThreads = reinterpret_cast<PFNGLMAXSHADERCOMPILERTHREADSKHRPROC>(
+      gl3wGetProcAddress(hasKHR ? "glMaxShaderCompilerThreadsKHR" : "glMaxShaderCompilerThreadsARB"));
+
+    if (maxCompilerThreads)
+    {
+      // NOTE(Isaac): this means "as many as the driver likes"
+      maxCompilerThreads(0xFFFFFFFF);
+      mode = PARALLEL_DRIVER;
+      return;
+    }
+  }
+
+  workerContext = CreateSharedGLContext();
+
+  if (workerContext)
+  {
+    mode = WORKER_THREAD;
+    worker = std::thread(&ShaderCompiler::WorkerMain, this);
+  }
+}
+
+ShaderCompiler::~ShaderCompiler()
+{
+  if (worker.joinable())
+  {
+    {
+      std::lock_guard<std::mutex> lock(pendingLock);
+      quit = true;
+    }
+
+    pendingChanged.notify_all();
+    worker.join();
+  }
+
+  DestroySharedGLContext(workerContext);
+
+  for (ShaderBuild* build : pending)
+  {
+    delete build;
+  }
+}
+
+Shader* ShaderCompiler::Enqueue(ShaderPermutations& permutations, ShaderFeatures features)
+{
+  auto it = permutations.variants.find(features);
+
+  if (it != permutations.variants.end())
+  {
+    return it->second;
+  }
+
+  std::string defines;
+  std::string name = permutations.basePath;
+
+  for (unsigned int i = 0u;
+       i < permutations.features.size();
+       i++)
+  {
+    if (features & (1u << i))
+    {
+      defines += "#define " + permutations.features[i] + "\n";
+      name += "+" + permutations.features[i];
+    }
+  }
+
+  Shader* shader = new Shader();
+  permutations.variants[features] = shader;
+
+  ShaderBuild* build = PrepareBuild(shader, permutations.basePath, defines);
+  build->name = name;
+
+  switch (mode)
+  {
+    case PARALLEL_DRIVER:
+    {
+      BeginBuild(*build);
+      pending.push_back(build);
+    } break;
+
+    case WORKER_THREAD:
+    {
+      {
+        std::lock_guard<std::mutex> lock(pendingLock);
+        pending.push_back(build);
+      }
+
+      pendingChanged.notify_all();
+    } break;
+
+    case MAIN_THREAD:
+    {
+      pending.push_back(build);
+    } break;
+  }
+
+  return shader;
+}
+
+void ShaderCompiler::Precompile(ShaderPermutations& permutations, std::initializer_list<ShaderFeatures> variants)
+{
+  for (ShaderFeatures features : variants)
+  {
+    Enqueue(permutations, features);
+  }
+}
+
+Shader* ShaderCompiler::GetVariant(ShaderPermutations& permutations, ShaderFeatures features)
+{
+  Shader* shader = Enqueue(permutations, features);
+
+  if (shader->ready)
+  {
+    return shader;
+  }
+
+  switch (mode)
+  {
+    case PARALLEL_DRIVER:
+    case MAIN_THREAD:
+    {
+      auto it = std::find_if(pending.begin(), pending.end(), [shader](ShaderBuild* build)
+                                                             {
+                                                               return build->shader == shader;
+                                                             });
+      ShaderBuild* build = *it;
+      pending.erase(it);
+
+      if (mode == MAIN_THREAD)
+      {
+        BeginBuild(*build);
+      }
+
+      FinishBuild(*build);
+      shader->ready = true;
+      delete build;
+    } break;
+
+    case WORKER_THREAD:
+    {
+      std::unique_lock<std::mutex> lock(pendingLock);
+
+      // NOTE(Isaac): the worker might have finished it (and emptied the queue) since we last looked
+      if (shader->ready)
+      {
+        return shader;
+      }
+
+      /*
+       * Move it to just behind whatever the worker's building at the moment, so we're not waiting on variants
+       * that nobody needs yet.
+       */
+      if (pending.size() > 1u)
+      {
+        auto it = std::find_if(pending.begin() + 1, pending.end(), [shader](ShaderBuild* build)
+                                                                   {
+                                                                     return build->shader == shader;
+                                                                   });
+        if (it != pending.end())
+        {
+          std::rotate(pending.begin() + 1, it, it + 1);
+        }
+      }
+
+      pendingChanged.wait(lock, [shader]() { return shader->ready.load(); });
+    } break;
+  }
+
+  return shader;
+}
+
+void ShaderCompiler::Update()
+{
+  switch (mode)
+  {
+    case PARALLEL_DRIVER:
+    {
+      for (auto it = pending.begin();
+           it != pending.end();)
+      {
+        ShaderBuild* build = *it;
+        GLint complete = GL_FALSE;
+        glGetProgramiv(build->shader->handle, GL_COMPLETION_STATUS_KHR, &complete);
+
+        if (complete)
+        {
+          FinishBuild(*build);
+          build->shader->ready = true;
+          delete build;
+          it = pending.erase(it);
+        }
+        else
+        {
+          ++it;
+        }
+      }
+    } break;
+
+    case WORKER_THREAD:
+    {
+      // NOTE(Isaac): the worker finishes everything off itself
+    } break;
+
+    case MAIN_THREAD:
+    {
+      // NOTE(Isaac): only build one a frame, so we never hitch for too long
+      if (!pending.empty())
+      {
+        ShaderBuild* build = pending.front();
+        pending.erase(pending.begin());
+        BeginBuild(*build);
+        FinishBuild(*build);
+        build->shader->ready = true;
+        delete build;
+      }
+    } break;
+  }
+}
+
+unsigned int ShaderCompiler::NumPending()
+{
+  std::lock_guard<std::mutex> lock(pendingLock);
+  return static_cast<unsigned int>(pending.size());
+}
+
+void ShaderCompiler::WorkerMain()
+{
+  MakeSharedGLContextCurrent(workerContext);
+
+  while (true)
+  {
+    ShaderBuild* build;
+
+    {
+      std::unique_lock<std::mutex> lock(pendingLock);
+      pendingChanged.wait(lock, [this]() { return quit || !pending.empty(); });
+
+      if (quit)
+      {
+        break;
+      }
+
+      // NOTE(Isaac): this stays in `pending` until it's finished, so `GetVariant` knows it's being built
+      build = pending.front();
+    }
+
+    BeginBuild(*build);
+    FinishBuild(*build);
+
+    // NOTE(Isaac): the main context can't use the program until the commands that made it have actually run
+    glFinish();
+
+    {
+      std::lock_guard<std::mutex> lock(pendingLock);
+      build->shader->ready = true;
+      pending.erase(std::find(pending.begin(), pending.end(), build));
+    }
+
+    pendingChanged.notify_all();
+    delete build;
+  }
+
+  MakeSharedGLContextCurrent(nullptr);
+}
+
+// --- Textures ---
+// NOTE(Isaac): S3TC is an extension, so it's not in our glcorearb.h (but every desktop driver has it)
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT   0x83F0
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT  0x83F3
+
+/*
+ * Checks that a mapped file is a cooked texture that's safe to read from, and returns its header (or nullptr,
+ * after saying what's wrong with it). This is called by the job system, so it mustn't touch GL.
+ */
+static const CookedTextureHeader* ValidateCookedTexture(const FileView& file, const char* path)
+{
+  const uint8_t* bytes = static_cast<const uint8_t*>(file.data);
+  const CookedTextureHeader* header = reinterpret_cast<const CookedTextureHeader*>(bytes);
+
+  if (file.size < sizeof(CookedTextureHeader) || header->magic != COOKED_TEXTURE_MAGIC)
+  {
+    fprintf(stderr, "Not a cooked texture: %s\n", path);
+    return nullptr;
+  }
+
+  if (header->version != COOKED_TEXTURE_VERSION || header->format >= NUM_TEXTURE_FORMATS)
+  {
+    fprintf(stderr, "Cooked texture is out of date (version %u), it needs recooking: %s\n", header->version, path);
+    return nullptr;
+  }
+
+  if (header->numMips == 0u || header->numMips > MAX_TEXTURE_MIPS ||
+      header->mipOffset + static_cast<size_t>(header->numMips) * sizeof(CookedMip) > file.size)
+  {
+    fprintf(stderr, "Cooked texture is truncated: %s\n", path);
+    return nullptr;
+  }
+
+  const CookedMip* mips = reinterpret_cast<const CookedMip*>(bytes + header->mipOffset);
+
+  for (unsigned int i = 0u;
+       i < header->numMips;
+       i++)
+  {
+    if (mips[i].size != GetTextureLevelSize(header->format, mips[i].width, mips[i].height) ||
+        static_cast<size_t>(mips[i].offset) + mips[i].size > file.size)
+    {
+      fprintf(stderr, "Cooked texture is truncated: %s\n", path);
+      return nullptr;
+    }
+  }
+
+  return header;
+}
+
+static const CookedMip* GetCookedMips(const CookedTextureHeader* header)
+{
+  return reinterpret_cast<const CookedMip*>(reinterpret_cast<const uint8_t*>(header) + header->mipOffset);
+}
+
+/*
+ * NOTE(Isaac): we don't light in linear space yet, so sRGB textures are still uploaded as plain RGBA. They've
+ * already had their mips filtered properly by the cooker, which is the part that shows.
+ */
+static GLenum GetTextureInternalFormat(TextureFormatType format)
+{
+  switch (format)
+  {
+    case TEXTURE_FORMAT_RGBA8:  return GL_RGBA8;
+    case TEXTURE_FORMAT_BC1:    return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    case TEXTURE_FORMAT_BC3:    return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    default:                    return GL_NONE;
+  }
+}
+
+/*
+ * Creates a texture with storage for every level of a cooked texture, and leaves it bound. If `upload` is set,
+ * the levels are filled in straight out of the file, otherwise they're left empty to be streamed into later.
+ */
+static GLuint CreateCookedTexture(const CookedTextureHeader* header, bool upload, const char* path)
+{
+  if (header->format != TEXTURE_FORMAT_RGBA8 && !HasExtension("GL_EXT_texture_compression_s3tc"))
+  {
+    fprintf(stderr, "FATAL: Texture is compressed, but the driver doesn't support S3TC: %s\n", path);
+    exit(1);
+  }
+
+  const uint8_t* bytes = reinterpret_cast<const uint8_t*>(header);
+  const CookedMip* mips = GetCookedMips(header);
+  GLenum internalFormat = GetTextureInternalFormat(header->format);
+
+  GLuint handle;
+  glGenTextures(1, &handle);
+  glBindTexture(GL_TEXTURE_2D, handle);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, header->numMips - 1u);
+
+  for (unsigned int i = 0u;
+       i < header->numMips;
+       i++)
+  {
+    const void* texels = upload ? (bytes + mips[i].offset) : nullptr;
+
+    if (header->format == TEXTURE_FORMAT_RGBA8)
+    {
+      glTexImage2D(GL_TEXTURE_2D, i, internalFormat, mips[i].width, mips[i].height, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+                   texels);
+    }
+    else
+    {
+      glCompressedTexImage2D(GL_TEXTURE_2D, i, internalFormat, mips[i].width, mips[i].height, 0, mips[i].size,
+                             texels);
+    }
+  }
+
+  return handle;
+}
+
+Texture::Texture()
+  :handle(0u)
+  ,width(0u)
+  ,height(0u)
+  ,loaded(false)
+{
+}
+
+/*
+ * Loads a texture that's been cooked by `tools/cooker`. Every level is uploaded straight out of the file, so
+ * there's no decoding or mip generation to do.
+ */
+Texture::Texture(const char* cookedPath)
+  :loaded(true)
+{
+  FileView file;
+  FileError error = OpenFile(cookedPath, file);
+
+  if (error != FILE_OK)
+  {
+    fprintf(stderr, "FATAL: Failed to open texture: %s (%s)\n", cookedPath, GetFileErrorString(error));
+    exit(1);
+  }
+
+  const CookedTextureHeader* header = ValidateCookedTexture(file, cookedPath);
+
+  if (!header)
+  {
+    exit(1);
+  }
+
+  this->handle  = CreateCookedTexture(header, true, cookedPath);
+  this->width   = header->width;
+  this->height  = header->height;
+
+  glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+Texture::~Texture()
+{
+  if (loaded)
+  {
+    glDeleteTextures(1, &(this->handle));
+  }
+}
+
+// --- Texture loader ---
+TextureLoader::TextureLoader(JobSystem& jobs)
+  :jobs(jobs)
+  ,placeholder(0u)
+  ,pixelBuffers{}
+  ,nextPixelBuffer(0u)
+  ,mappedLock()
+  ,mapped()
+  ,uploads()
+  ,numMapping(0u)
+{
+  // NOTE(Isaac): mid-grey, so things don't flash while they're loading
+  static const uint8_t PLACEHOLDER_PIXEL[4u] = { 128u, 128u, 128u, 255u };
+
+  glGenTextures(1, &placeholder);
+  glBindTexture(GL_TEXTURE_2D, placeholder);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, PLACEHOLDER_PIXEL);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  glGenBuffers(NUM_PIXEL_BUFFERS, pixelBuffers);
+}
+
+TextureLoader::~TextureLoader()
+{
+  // NOTE(Isaac): the jobs write into `mapped`, so we can't go anywhere until they're done
+  jobs.WaitIdle();
+
+  for (PendingTexture& pending : uploads)
+  {
+    glDeleteTextures(1, &(pending.handle));
+  }
+
+  glDeleteBuffers(NUM_PIXEL_BUFFERS, pixelBuffers);
+  glDeleteTextures(1, &placeholder);
+}
+
+void TextureLoader::Load(Texture& texture, const char* cookedPath)
+{
+  texture.handle = placeholder;
+  texture.width = 1u;
+  texture.height = 1u;
+  texture.loaded = false;
+
+  {
+    std::lock_guard<std::mutex> lock(mappedLock);
+    numMapping++;
+  }
+
+  Texture* target = &texture;
+  std::string texturePath(cookedPath);
+
+  jobs.Submit([this, target, texturePath]()
+    {
+      PendingTexture pending{target, texturePath, FileView(), nullptr, 0u, 0u, 0u};
+      FileError error = OpenFile(texturePath.c_str(), pending.file);
+
+      if (error != FILE_OK)
+      {
+        fprintf(stderr, "Failed to open texture: %s (%s)\n", texturePath.c_str(), GetFileErrorString(error));
+      }
+      else
+      {
+        pending.header = ValidateCookedTexture(pending.file, texturePath.c_str());
+
+        // NOTE(Isaac): otherwise, it'd be the main thread waiting on the disk when it copies the texels out
+        if (pending.header)
+        {
+          PageIn(pending.file.data, pending.file.size);
+        }
+      }
+
+      std::lock_guard<std::mutex> lock(mappedLock);
+      mapped.push_back(std::move(pending));
+      numMapping--;
+    });
+}
+
+void TextureLoader::Update(RenderStats& stats)
+{
+  {
+    std::lock_guard<std::mutex> lock(mappedLock);
+
+    for (PendingTexture& pending : mapped)
+    {
+      // NOTE(Isaac): the job has already said what went wrong
+      if (!pending.header)
+      {
+        continue;
+      }
+
+      // NOTE(Isaac): we allocate every level up front, then fill them in over however many frames it takes
+      pending.handle = CreateCookedTexture(pending.header, false, pending.path.c_str());
+      uploads.push_back(std::move(pending));
+    }
+
+    mapped.clear();
+  }
+
+  unsigned int budget = TEXTURE_UPLOAD_BUDGET;
+
+  while (!uploads.empty() && budget > 0u)
+  {
+    PendingTexture& pending = uploads.front();
+    const CookedMip& mip = GetCookedMips(pending.header)[pending.level];
+    const TextureFormatType format = pending.header->format;
+    const unsigned int rowHeight = GetTextureRowHeight(format);
+    const unsigned int rowSize = GetTextureRowSize(format, mip.width);
+
+    // NOTE(Isaac): always upload at least one row, so a huge level can't get stuck
+    unsigned int rowsLeft = (mip.height - pending.nextRow + rowHeight - 1u) / rowHeight;
+    unsigned int numRows = std::min(rowsLeft, std::max(budget / rowSize, 1u));
+    unsigned int height = std::min(numRows * rowHeight, mip.height - pending.nextRow);
+    unsigned int size = numRows * rowSize;
+    const uint8_t* texels = static_cast<const uint8_t*>(pending.file.data) + mip.offset +
+                            (pending.nextRow / rowHeight) * rowSize;
+
+    /*
+     * The buffers are used round-robin, and orphaned each time, so we never have to wait for the GPU to
+     * finish reading from one before we can write into it again.
+     */
+    GLuint pixelBuffer = pixelBuffers[nextPixelBuffer];
+    nextPixelBuffer = (nextPixelBuffer + 1u) % NUM_PIXEL_BUFFERS;
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixelBuffer);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, size, nullptr, GL_STREAM_DRAW);
+    void* staging = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+
+    /*
+     * NOTE(Isaac): mapping can fail (e.g. if the driver's out of memory), and the contents of a mapping can be
+     * lost before it's unmapped, so either way we have the driver copy them in for us instead.
+     */
+    bool copied = false;
+    if (staging)
+    {
+      memcpy(staging, texels, size);
+      copied = (glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER) == GL_TRUE);
+    }
+
+    if (!copied)
+    {
+      glBufferSubData(GL_PIXEL_UNPACK_BUFFER, 0, size, texels);
+    }
+
+    glBindTexture(GL_TEXTURE_2D, pending.handle);
+
+    if (format == TEXTURE_FORMAT_RGBA8)
+    {
+      glTexSubImage2D(GL_TEXTURE_2D, pending.level, 0, pending.nextRow, mip.width, height, GL_RGBA,
+                      GL_UNSIGNED_BYTE, nullptr);
+    }
+    else
+    {
+      glCompressedTexSubImage2D(GL_TEXTURE_2D, pending.level, 0, pending.nextRow, mip.width, height,
+                                GetTextureInternalFormat(format), size, nullptr);
+    }
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    pending.nextRow += height;
+    budget -= std::min(budget, size);
+    stats.bufferUploads++;
+    stats.uploadedBytes += size;
+
+    if (pending.nextRow == mip.height)
+    {
+      pending.level++;
+      pending.nextRow = 0u;
+    }
+
+    if (pending.level == pending.header->numMips)
+    {
+      pending.texture->handle = pending.handle;
+      pending.texture->width = pending.header->width;
+      pending.texture->height = pending.header->height;
+      pending.texture->loaded = true;
+      uploads.pop_front();
+    }
+  }
+
+  glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+unsigned int TextureLoader::NumPending()
+{
+  std::lock_guard<std::mutex> lock(mappedLock);
+  return numMapping + static_cast<unsigned int>(mapped.size() + uploads.size());
+}
+
+// --- Mesh loader ---
+MeshLoader::MeshLoader(JobSystem& jobs)
+  :jobs(jobs)
+  ,mappedLock()
+  ,mapped()
+  ,numMapping(0u)
+{
+}
+
+MeshLoader::~MeshLoader()
+{
+  // NOTE(Isaac): the jobs write into `mapped`, so we can't go anywhere until they're done
+  jobs.WaitIdle();
+}
+
+void MeshLoader::Load(Mesh& mesh, const char* cookedPath)
+{
+  {
+    std::lock_guard<std::mutex> lock(mappedLock);
+    numMapping++;
+  }
+
+  Mesh* target = &mesh;
+  std::string meshPath(cookedPath);
+
+  jobs.Submit([this, target, meshPath]()
+    {
+      PendingMesh pending{target, meshPath, FileView(), nullptr};
+      FileError error = OpenFile(meshPath.c_str(), pending.file);
+
+      if (error != FILE_OK)
+      {
+        fprintf(stderr, "Failed to open mesh: %s (%s)\n", meshPath.c_str(), GetFileErrorString(error));
+      }
+      else
+      {
+        pending.header = ValidateCookedMesh(pending.file, meshPath.c_str());
+
+        if (pending.header)
+        {
+          PageIn(pending.file.data, pending.file.size);
+        }
+      }
+
+      std::lock_guard<std::mutex> lock(mappedLock);
+      mapped.push_back(std::move(pending));
+      numMapping--;
+    });
+}
+
+bool MeshLoader::Update()
+{
+  std::lock_guard<std::mutex> lock(mappedLock);
+  bool anyLoaded = false;
+
+  for (PendingMesh& pending : mapped)
+  {
+    // NOTE(Isaac): if it couldn't be loaded, the job has already said why
+    if (pending.header)
+    {
+      CreateCookedMesh(*(pending.mesh), pending.header);
+      anyLoaded = true;
+    }
+  }
+
+  // NOTE(Isaac): this closes the files, now GL has its own copies of them
+  mapped.clear();
+  return anyLoaded;
+}
+
+unsigned int MeshLoader::NumPending()
+{
+  std::lock_guard<std::mutex> lock(mappedLock);
+  return numMapping + static_cast<unsigned int>(mapped.size());
+}
+
+// --- Asset registry ---
+AssetRegistry::AssetRegistry(JobSystem& jobs)
+  :numDeduplicated(0u)
+  ,meshLoader(jobs)
+  ,textureLoader(jobs)
+  ,meshes()
+  ,textures()
+  ,orphanedMeshes()
+  ,orphanedTextures()
+{
+}
+
+AssetRegistry::~AssetRegistry()
+{
+  if (!meshes.empty() || !textures.empty())
+  {
+    fprintf(stderr, "WARNING: %u meshes and %u textures are still referenced, but the asset registry is going away\n",
+            NumMeshes(), NumTextures());
+  }
+
+  // NOTE(Isaac): wait for the loaders, because they might still be writing into the assets
+  while (meshLoader.NumPending() > 0u || textureLoader.NumPending() > 0u)
+  {
+    RenderStats stats;
+    Update(stats);
+  }
+
+  for (auto& mapping : meshes)
+  {
+    delete mapping.second->asset;
+    delete mapping.second;
+  }
+
+  for (auto& mapping : textures)
+  {
+    delete mapping.second->asset;
+    delete mapping.second;
+  }
+
+  for (Mesh* mesh : orphanedMeshes)
+  {
+    delete mesh;
+  }
+
+  for (Texture* texture : orphanedTextures)
+  {
+    delete texture;
+  }
+}
+
+MeshHandle AssetRegistry::LoadMesh(const std::string& cookedPath)
+{
+  // NOTE(Isaac): different ways of writing the same path should still find the same asset
+  std::string path = NormalisePath(cookedPath);
+  auto it = meshes.find(path);
+
+  if (it != meshes.end())
+  {
+    numDeduplicated++;
+    return MeshHandle(it->second);
+  }
+
+  AssetSlot<Mesh>* slot = new AssetSlot<Mesh>{new Mesh(), path, 0u, this};
+  meshes[path] = slot;
+  meshLoader.Load(*(slot->asset), path.c_str());
+  return MeshHandle(slot);
+}
+
+TextureHandle AssetRegistry::LoadTexture(const std::string& cookedPath)
+{
+  // NOTE(Isaac): different ways of writing the same path should still find the same asset
+  std::string path = NormalisePath(cookedPath);
+  auto it = textures.find(path);
+
+  if (it != textures.end())
+  {
+    numDeduplicated++;
+    return TextureHandle(it->second);
+  }
+
+  AssetSlot<Texture>* slot = new AssetSlot<Texture>{new Texture(), path, 0u, this};
+  textures[path] = slot;
+  textureLoader.Load(*(slot->asset), path.c_str());
+  return TextureHandle(slot);
+}
+
+bool AssetRegistry::Update(RenderStats& stats)
+{
+  bool meshesLoaded = meshLoader.Update();
+  textureLoader.Update(stats);
+
+  if (meshLoader.NumPending() == 0u)
+  {
+    for (Mesh* mesh : orphanedMeshes)
+    {
+      delete mesh;
+    }
+
+    orphanedMeshes.clear();
+  }
+
+  if (textureLoader.NumPending() == 0u)
+  {
+    for (Texture* texture : orphanedTextures)
+    {
+      delete texture;
+    }
+
+    orphanedTextures.clear();
+  }
+
+  return meshesLoaded;
+}
+
+unsigned int AssetRegistry::NumPending()
+{
+  return meshLoader.NumPending() + textureLoader.NumPending();
+}
+
+unsigned int AssetRegistry::NumMeshes() const
+{
+  return static_cast<unsigned int>(meshes.size());
+}
+
+unsigned int AssetRegistry::NumTextures() const
+{
+  return static_cast<unsigned int>(textures.size());
+}
+
+void ReleaseAsset(AssetSlot<Mesh>* slot)
+{
+  AssetRegistry* registry = slot->registry;
+
+  if (slot->asset->loaded)
+  {
+    delete slot->asset;
+  }
+  else
+  {
+    registry->orphanedMeshes.push_back(slot->asset);
+  }
+
+  registry->meshes.erase(slot->path);
+  delete slot;
+}
+
+void ReleaseAsset(AssetSlot<Texture>* slot)
+{
+  AssetRegistry* registry = slot->registry;
+
+  if (slot->asset->loaded)
+  {
+    delete slot->asset;
+  }
+  else
+  {
+    registry->orphanedTextures.push_back(slot->asset);
+  }
+
+  registry->textures.erase(slot->path);
+  delete slot;
+}
+
+// --- Render targets ---
+RenderTarget::RenderTarget()
+  :framebuffer(0u)
+  ,colorTexture(0u)
+  ,width(0u)
+  ,height(0u)
+{
+}
+
+RenderTarget::~RenderTarget()
+{
+  glDeleteFramebuffers(1, &framebuffer);
+  glDeleteTextures(1, &colorTexture);
+}
 
-// --- Meshes ---
-Mesh::Mesh(const MeshData& meshData)
-  :numElements(meshData.numIndices)
+void RenderTarget::Resize(unsigned int newWidth, unsigned int newHeight)
 {
-  glGenVertexArrays(1, &(this->vao));
-  glBindVertexArray(this->vao);
+  if (!framebuffer)
+  {
+    glGenFramebuffers(1, &framebuffer);
+    glGenTextures(1, &colorTexture);
+  }
 
-  glEnableVertexAttribArray(0);
-  glEnableVertexAttribArray(1);
-  glEnableVertexAttribArray(2);
-  glEnableVertexAttribArray(3);
+  width = newWidth;
+  height = newHeight;
 
-  glGenBuffers(1, &(this->vbo));
-  glBindBuffer(GL_ARRAY_BUFFER, this->vbo);
-  glBufferData(GL_ARRAY_BUFFER, meshData.numVertices * sizeof(Vertex), meshData.vertices, GL_STATIC_DRAW);
+  glBindTexture(GL_TEXTURE_2D, colorTexture);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glBindTexture(GL_TEXTURE_2D, 0u);
 
-  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (const void*)(offsetof(Vertex, position)));
-  glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (const void*)(offsetof(Vertex, texCoord)));
+  glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTexture, 0);
 
-  glGenBuffers(1, &(this->ebo));
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->ebo);
-  glBufferData(GL_ELEMENT_ARRAY_BUFFER, numElements * sizeof(GLuint), meshData.indices, GL_STATIC_DRAW);
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+  {
+    std::cerr << "Failed to create render target!" << std::endl;
+  }
 
-  glBindVertexArray(0);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0u);
 }
 
-Mesh::~Mesh()
+// --- Entity instances ---
+EntityInstances::EntityInstances()
+  :transformBuffer(0u)
+  ,transformTexture(0u)
+  ,transformCapacity(0u)
+  ,indexBuffer(0u)
+  ,indexCapacity(0u)
+  ,layout()
+  ,draws()
+  ,batched(false)
+  ,batchItems()
+  ,indices()
 {
-  glDeleteBuffers(1, &(this->vbo));
-  glDeleteBuffers(1, &(this->ebo));
-  glDeleteVertexArrays(1, &(this->vao));
 }
 
-void DrawMesh(Mesh& mesh)
+EntityInstances::~EntityInstances()
 {
-  glBindVertexArray(mesh.vao);
-  glDrawElements(GL_TRIANGLES, mesh.numElements, GL_UNSIGNED_INT, 0);
+  glDeleteTextures(1, &transformTexture);
+  glDeleteBuffers(1, &transformBuffer);
+  glDeleteBuffers(1, &indexBuffer);
 }
 
-// --- Shaders ---
-enum ShaderPart
+// --- Render queue ---
+uint64_t MakeSortKey(RenderPass pass, GLuint shader, GLuint texture, GLuint vao, unsigned int depth)
 {
-  VERTEX,
-  FRAGMENT,
-};
+  return (static_cast<uint64_t>(pass    & 0xF)      << 60u) |
+         (static_cast<uint64_t>(shader  & 0xFF)     << 52u) |
+         (static_cast<uint64_t>(texture & 0xFFF)    << 40u) |
+         (static_cast<uint64_t>(vao     & 0xFFFF)   << 24u) |
+         (static_cast<uint64_t>(depth   & 0xFFFFFF));
+}
 
-static GLuint LoadShaderPart(ShaderPart part, const char* path)
+GLStateCache::GLStateCache()
+  :program(0u)
+  ,vao(0u)
+  ,texture(0u)
+  ,textureTarget(GL_TEXTURE_2D)
+  ,instanceTransforms(0u)
+  ,colors()
+  ,dequantisedMesh(nullptr)
 {
-  GLuint handle = 0;
+}
 
-  switch (part)
+void GLStateCache::Reset()
+{
+  program = 0u;
+  vao = 0u;
+  texture = 0u;
+  textureTarget = GL_TEXTURE_2D;
+  instanceTransforms = 0u;
+
+  /*
+   * NOTE(Isaac): nothing else touches our programs' uniforms, so we can keep the cached colors. We forget which
+   * mesh was dequantised though, because meshes can be unloaded (and another loaded at the same address).
+   */
+  dequantisedMesh = nullptr;
+
+  glUseProgram(0u);
+  glBindVertexArray(0u);
+  glActiveTexture(GL_TEXTURE0 + INSTANCE_TRANSFORMS_UNIT);
+  glBindTexture(GL_TEXTURE_BUFFER, 0u);
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, 0u);
+}
+
+bool GLStateCache::BindProgram(GLuint newProgram)
+{
+  if (program == newProgram)
   {
-    case VERTEX:    handle = glCreateShader(GL_VERTEX_SHADER);    break;
-    case FRAGMENT:  handle = glCreateShader(GL_FRAGMENT_SHADER);  break;
+    return false;
   }
 
-  char* sourceString = LoadFileAsString(path);
-  glShaderSource(handle, 1, &sourceString, nullptr);
-  glCompileShader(handle);
-  free(sourceString);
+  glUseProgram(newProgram);
+  program = newProgram;
+  return true;
+}
 
-  GLint success = GL_FALSE;
-  int messageLength;
-  glGetShaderiv(handle, GL_COMPILE_STATUS, &success);
-  glGetShaderiv(handle, GL_INFO_LOG_LENGTH, &messageLength);
+bool GLStateCache::BindVertexArray(GLuint newVAO)
+{
+  if (vao == newVAO)
+  {
+    return false;
+  }
 
-  if (!success)
+  glBindVertexArray(newVAO);
+  vao = newVAO;
+  return true;
+}
+
+bool GLStateCache::BindTexture(GLenum target, GLuint newTexture)
+{
+  if (textureTarget == target && texture == newTexture)
   {
-    char message[messageLength + 1u];
-    glGetShaderInfoLog(handle, messageLength, nullptr, message);
-    std::cerr << "Failed to compile shader: " << message << std::endl;
+    return false;
   }
 
-  return handle;
+  glBindTexture(target, newTexture);
+  textureTarget = target;
+  texture = newTexture;
+  return true;
 }
 
 /*
- * Vertex shader should be located at {basePath}.vert
- * Fragment shader should be located at {basePath}.frag
+ * Every other texture is bound to unit 0, so this is the only thing that needs to switch units.
  */
-Shader::Shader(const char* basePath)
-  :textureCount(0u)
-{
-  // Load the vertex shader
-  char* vertexPath = static_cast<char*>(malloc(sizeof(char) * (strlen(basePath) + strlen(".vert") + 1u)));
-  strcpy(vertexPath, basePath);
-  strcat(vertexPath, ".vert");
-  GLuint vertex = LoadShaderPart(ShaderPart::VERTEX, vertexPath);
-  free(vertexPath);
-
-  // Load the fragment shader
-  char* fragmentPath = static_cast<char*>(malloc(sizeof(char) * (strlen(basePath) + strlen(".frag") + 1u)));
-  strcpy(fragmentPath, basePath);
-  strcat(fragmentPath, ".frag");
-  GLuint fragment = LoadShaderPart(ShaderPart::FRAGMENT, fragmentPath);
-  free(fragmentPath);
-
-  // Create the shader program
-  this->handle = glCreateProgram();
-  glAttachShader(this->handle, vertex);
-  glAttachShader(this->handle, fragment);
-  glLinkProgram(this->handle);
-
-  GLint success;
-  int messageLength;
-  glGetProgramiv(this->handle, GL_LINK_STATUS, &success);
-  glGetProgramiv(this->handle, GL_INFO_LOG_LENGTH, &messageLength);
-
-  if (!success)
+bool GLStateCache::BindInstanceTransforms(GLuint newTexture)
+{
+  if (instanceTransforms == newTexture)
   {
-    char message[messageLength + 1u];
-    glGetProgramInfoLog(this->handle, messageLength, nullptr, message);
-    std::cerr << "Failed to link shader program: " << message << std::endl;
+    return false;
   }
 
-  glDetachShader(this->handle, vertex);
-  glDetachShader(this->handle, fragment);
-  glDeleteShader(vertex);
-  glDeleteShader(fragment);
+  glActiveTexture(GL_TEXTURE0 + INSTANCE_TRANSFORMS_UNIT);
+  glBindTexture(GL_TEXTURE_BUFFER, newTexture);
+  glActiveTexture(GL_TEXTURE0);
+  instanceTransforms = newTexture;
+  return true;
 }
 
-Shader::~Shader()
+/*
+ * Uniform values are part of a program's state, so they're cached per-program, and survive switching between
+ * programs.
+ */
+bool GLStateCache::SetColor(GLuint colorProgram, GLint location, const Vec<4u>& color)
 {
-  glDeleteProgram(this->handle);
+  const uint64_t key = (static_cast<uint64_t>(colorProgram) << 32u) | static_cast<uint32_t>(location);
+  auto it = colors.find(key);
+
+  if (it != colors.end() && it->second == color)
+  {
+    return false;
+  }
+
+  glUniform4f(location, color.x(), color.y(), color.z(), color.w());
+  colors[key] = color;
+  return true;
 }
 
-void UseShader(Shader& shader)
+/*
+ * Only the packed entity shader has these uniforms, so they don't need caching per-program like the colors.
+ */
+bool GLStateCache::SetDequantisation(GLint scaleLocation, GLint offsetLocation, const Mesh* mesh)
 {
-  glUseProgram(shader.handle);
-  shader.textureCount = 0u;
+  if (dequantisedMesh == mesh)
+  {
+    return false;
+  }
+
+  glUniform3f(scaleLocation, mesh->dequantisationScale.x(), mesh->dequantisationScale.y(), mesh->dequantisationScale.z());
+  glUniform3f(offsetLocation, mesh->dequantisationOffset.x(), mesh->dequantisationOffset.y(), mesh->dequantisationOffset.z());
+  dequantisedMesh = mesh;
+  return true;
 }
 
-template<>
-void SetUniform<Texture>(Shader& shader, const char* name, const Texture& value)
+// --- Camera ---
+Camera::Camera(float viewWidth, float viewHeight)
+  :position()
+  ,zoom(1.0f)
+  ,viewWidth(viewWidth)
+  ,viewHeight(viewHeight)
 {
-  glActiveTexture(GL_TEXTURE0 + shader.textureCount);
-  glBindTexture(GL_TEXTURE_2D, value.handle);
-  glUniform1i(glGetUniformLocation(shader.handle, name), shader.textureCount);
-  shader.textureCount++;
 }
 
-template<>
-void SetUniform<Vec<4u>>(Shader& shader, const char* name, const Vec<4u>& v)
+void Camera::Pan(const Vec<2u>& pixels)
 {
-  glUniform4f(glGetUniformLocation(shader.handle, name), v.x(), v.y(), v.z(), v.w());
+  position += pixels / zoom;
 }
 
-template<>
-void SetUniform<Mat<4u>>(Shader& shader, const char* name, const Mat<4u>& mat)
+/*
+ * Zooms while keeping the point of the world under `windowPoint` in the same place.
+ */
+void Camera::ZoomAt(const Vec<2u>& windowPoint, float factor)
 {
-  glUniformMatrix4fv(glGetUniformLocation(shader.handle, name), 1, GL_FALSE, &(mat[0u][0u]));
+  Vec<2u> anchor = WindowToWorld(windowPoint);
+  zoom *= factor;
+  position += anchor - WindowToWorld(windowPoint);
 }
 
-// --- Textures ---
-Texture::Texture(const char* path)
+Vec<2u> Camera::WindowToWorld(const Vec<2u>& windowPoint) const
 {
-  glGenTextures(1, &(this->handle));
-  glBindTexture(GL_TEXTURE_2D, this->handle);
-
-  int iWidth, iHeight, componentsPerPixel;
-  unsigned char* data = stbi_load(path, &iWidth, &iHeight, &componentsPerPixel, 0);
-  this->width   = static_cast<unsigned int>(iWidth);
-  this->height  = static_cast<unsigned int>(iHeight);
-
-  switch (componentsPerPixel)
-  {
-    case 3u:
-    {
-      glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, this->width, this->height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-    } break;
-
-    case 4u:
-    {
-      glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, this->width, this->height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-    } break;
-
-    default:
-    {
-      std::cerr << "Failed to read texture: " << path << std::endl;
-    } break;
-  }
-
-  glGenerateMipmap(GL_TEXTURE_2D);
+  return position + Vec<2u>(windowPoint.x(), viewHeight - windowPoint.y()) / zoom;
+}
 
-  stbi_image_free(data);
-  glBindTexture(GL_TEXTURE_2D, 0);
+Rect Camera::GetViewBounds() const
+{
+  return Rect(position, position + Vec<2u>(viewWidth, viewHeight) / zoom);
 }
 
-Texture::~Texture()
+Mat<4u> Camera::GetProjection() const
 {
-  glDeleteTextures(1, &(this->handle));
+  return OrthographicProjection<4u>(viewWidth / zoom, viewHeight / zoom, 0.1f, 100.0f) *
+         Translation<4u>(Vec<3u>(-position.x(), -position.y(), 0.0f));
 }
 
 // --- Renderer ---
 Renderer::Renderer(unsigned int width, unsigned int height)
   :width(width)
   ,height(height)
-  ,shader("./res/test")
+  ,worldShaders("./res/world", { "CELL_COLORS" })
+  ,entityShaders("./res/entity", { "PACKED_VERTICES" })
+  ,compositeShaders("./res/composite", {})
+  ,shaderCompiler()
+  ,shader(nullptr)
+  ,entityShader{}
+  ,cellShader(nullptr)
+  ,compositeShader(nullptr)
+  ,camera(static_cast<float>(width), static_cast<float>(height))
 //  ,projection(PerspectiveProjection<4u>(RADIANS(45.0f), (float)width / (float)height, 0.1f, 100.0f))
-  ,projection(OrthographicProjection<4u>(1920.0f, 1080.0f, 0.1f, 100.0f))
+  ,projection(camera.GetProjection())
+  ,frameUBO(0u)
+  ,colorUniform(-1)
+  ,cellColorsUniform(-1)
+  ,dequantisationScaleUniform(-1)
+  ,dequantisationOffsetUniform(-1)
+  ,emptyVAO(0u)
+  ,batchEntities(true)
+  ,stats()
+  ,frameStats()
+  ,queueLock()
+  ,queue()
+  ,stateCache()
+  ,multiDrawFirsts()
+  ,multiDrawCounts()
+  ,multiDrawOffsets()
 {
+  /*
+   * Kick off every variant we need at once, so they can be built in parallel, and only then wait for them.
+   * We report how long that took, so we can compare a cold start (compiling everything from source) with a
+   * warm one (restoring everything from the binary cache).
+   */
+  auto shaderStartTime = std::chrono::high_resolution_clock::now();
+  const ShaderFeatures CELL_COLORS = GetShaderFeature(worldShaders, "CELL_COLORS");
+  shaderCompiler.Precompile(worldShaders, { 0u, CELL_COLORS });
+  const ShaderFeatures PACKED_VERTICES = GetShaderFeature(entityShaders, "PACKED_VERTICES");
+  shaderCompiler.Precompile(entityShaders, { 0u, PACKED_VERTICES });
+  shaderCompiler.Precompile(compositeShaders, { 0u });
+
+  shader          = shaderCompiler.GetVariant(worldShaders, 0u);
+  cellShader      = shaderCompiler.GetVariant(worldShaders, CELL_COLORS);
+  entityShader[VERTEX_FORMAT_FLOAT]   = shaderCompiler.GetVariant(entityShaders, 0u);
+  entityShader[VERTEX_FORMAT_PACKED]  = shaderCompiler.GetVariant(entityShaders, PACKED_VERTICES);
+  compositeShader = shaderCompiler.GetVariant(compositeShaders, 0u);
+
+  const Shader* shaders[] = { shader, cellShader, entityShader[VERTEX_FORMAT_FLOAT],
+                              entityShader[VERTEX_FORMAT_PACKED], compositeShader };
+  const unsigned int numShaders = sizeof(shaders) / sizeof(shaders[0]);
+  unsigned int numCached = 0u;
+
+  for (const Shader* s : shaders)
+  {
+    numCached += s->fromCache ? 1u : 0u;
+  }
+
+  float shaderTime = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() -
+                                                              shaderStartTime).count();
+  printf("Loaded %u shaders in %.2fms (%u from cache, %s start)\n", numShaders, shaderTime, numCached,
+         (numCached == numShaders) ? "warm" : "cold");
+
+  colorUniform      = GetUniformLocation(*shader, "color");
+  cellColorsUniform = GetUniformLocation(*cellShader, "cellColors");
+  dequantisationScaleUniform  = GetUniformLocation(*entityShader[VERTEX_FORMAT_PACKED], "dequantisationScale");
+  dequantisationOffsetUniform = GetUniformLocation(*entityShader[VERTEX_FORMAT_PACKED], "dequantisationOffset");
+
+  glGenBuffers(1, &frameUBO);
+  glBindBuffer(GL_UNIFORM_BUFFER, frameUBO);
+  glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniforms), nullptr, GL_DYNAMIC_DRAW);
+  glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_UNIFORMS_BINDING, frameUBO);
+
+  // NOTE(Isaac): textures are always bound to the same units, so the samplers only need to be set once
+  for (Shader* variant : entityShader)
+  {
+    UseShader(*variant);
+    glUniform1i(GetUniformLocation(*variant, "diffuse"), 0);
+    glUniform1i(GetUniformLocation(*variant, "instanceTransforms"), INSTANCE_TRANSFORMS_UNIT);
+  }
+
+  UseShader(*cellShader);
+  glUniform1i(cellColorsUniform, 0);
+  UseShader(*compositeShader);
+  glUniform1i(GetUniformLocation(*compositeShader, "source"), 0);
+
+  // NOTE(Isaac): the core profile won't draw without a VAO bound, even if there aren't any attributes
+  glGenVertexArrays(1, &emptyVAO);
+
   glViewport(0, 0, width, height);
   glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
 
@@ -224,6 +1969,12 @@ Renderer::Renderer(unsigned int width, unsigned int height)
   glFrontFace(GL_CCW);*/
 }
 
+Renderer::~Renderer()
+{
+  glDeleteBuffers(1, &frameUBO);
+  glDeleteVertexArrays(1, &emptyVAO);
+}
+
 static Mat<4u> CalculateCameraViewMatrix(const Vec<3u>& cameraPos, const Vec<3u>& targetPos)
 {
   const Vec<3u> up(0.0f, 1.0f, 0.0f);
@@ -252,27 +2003,422 @@ static Mat<4u> CalculateCameraViewMatrix(const Vec<3u>& cameraPos, const Vec<3u>
 void Renderer::StartFrame()
 {
   PrepareFrame();
+  shaderCompiler.Update();
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-  UseShader(shader);
-  SetUniform(shader, "projection", projection);
+  projection = camera.GetProjection();
+
+  FrameUniforms frameUniforms;
+  frameUniforms.projection = projection;
+  glBindBuffer(GL_UNIFORM_BUFFER, frameUBO);
+  glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameUniforms), &frameUniforms);
+}
+
+static_assert(sizeof(LocalToWorld) == sizeof(Mat<4u>), "LocalToWorlds are uploaded straight out of their chunks");
+
+bool Renderer::UpdateEntityTransforms(EntityInstances& instances, EntityManager& entities)
+{
+  const ComponentId LOCAL_TO_WORLD = GetComponentId<LocalToWorld>();
+  const ComponentId RENDERABLE = GetComponentId<Renderable>();
+  const Signature query = MakeSignature<LocalToWorld, Renderable>();
+
+  if (!instances.transformBuffer)
+  {
+    glGenBuffers(1, &(instances.transformBuffer));
+    glGenTextures(1, &(instances.transformTexture));
+    glGenBuffers(1, &(instances.indexBuffer));
+
+    glBindBuffer(GL_TEXTURE_BUFFER, instances.transformBuffer);
+    glBindTexture(GL_TEXTURE_BUFFER, instances.transformTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, instances.transformBuffer);
+    glBindTexture(GL_TEXTURE_BUFFER, 0u);
+  }
+
+  // Lay the archetypes out again, but only if their chunks have changed since last time
+  bool relayout = false;
+  unsigned int numRanges = 0u;
+  unsigned int numTransforms = 0u;
+
+  for (Archetype* archetype : entities.GetArchetypes())
+  {
+    if ((archetype->signature & query) != query)
+    {
+      continue;
+    }
+
+    const EntityInstances::ArchetypeRange range{archetype, numTransforms, static_cast<unsigned int>(archetype->chunks.size())};
+    numTransforms += range.numChunks * archetype->chunkCapacity;
+
+    if (numRanges == instances.layout.size())
+    {
+      instances.layout.push_back(range);
+      relayout = true;
+    }
+    else if (instances.layout[numRanges].archetype != range.archetype ||
+             instances.layout[numRanges].firstTransform != range.firstTransform ||
+             instances.layout[numRanges].numChunks != range.numChunks)
+    {
+      instances.layout[numRanges] = range;
+      relayout = true;
+    }
+
+    numRanges++;
+  }
+
+  if (numRanges != instances.layout.size())
+  {
+    instances.layout.resize(numRanges);
+    relayout = true;
+  }
+
+  glBindBuffer(GL_TEXTURE_BUFFER, instances.transformBuffer);
+
+  if (numTransforms > instances.transformCapacity)
+  {
+    // NOTE(Isaac): each transform takes up four texels of the buffer texture
+    GLint maxTexels = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+
+    if (static_cast<size_t>(numTransforms) * 4u > static_cast<size_t>(maxTexels))
+    {
+      fprintf(stderr, "FATAL: Too many entities to draw (%u transforms, but only room for %d)\n", numTransforms,
+              maxTexels / 4);
+      exit(1);
+    }
+
+    instances.transformCapacity = numTransforms;
+    glBufferData(GL_TEXTURE_BUFFER, instances.transformCapacity * sizeof(Mat<4u>), nullptr, GL_DYNAMIC_DRAW);
+  }
+
+  /*
+   * Each chunk's transforms are uploaded straight out of its `LocalToWorld` column, and only if they've changed
+   * (or everything has moved). The `Renderable` flags are set whenever entities are moved between rows, which
+   * is when the batches' indices go stale.
+   */
+  bool rebatch = relayout;
+
+  for (const EntityInstances::ArchetypeRange& range : instances.layout)
+  {
+    const int column = range.archetype->FindColumn(LOCAL_TO_WORLD);
+
+    for (unsigned int i = 0u;
+         i < range.numChunks;
+         i++)
+    {
+      Chunk& chunk = range.archetype->chunks[i];
+
+      if (relayout || chunk.changed.test(LOCAL_TO_WORLD))
+      {
+        const size_t offset = (range.firstTransform + i * range.archetype->chunkCapacity) * sizeof(Mat<4u>);
+        const size_t size = chunk.count * sizeof(Mat<4u>);
+
+        glBufferSubData(GL_TEXTURE_BUFFER, offset, size, range.archetype->GetColumn<LocalToWorld>(chunk, column));
+        frameStats.bufferUploads++;
+        frameStats.uploadedBytes += size;
+      }
+
+      rebatch |= chunk.changed.test(RENDERABLE);
+      chunk.changed.reset(LOCAL_TO_WORLD);
+      chunk.changed.reset(RENDERABLE);
+    }
+  }
+
+  return rebatch;
+}
+
+void Renderer::BatchEntities(EntityInstances& instances, EntityManager& entities, const std::vector<Entity>& visible)
+{
+  std::vector<EntityBatchItem>& batchItems = instances.batchItems;
+  batchItems.clear();
+
+  for (Entity entity : visible)
+  {
+    const EntityLocation* location = entities.GetLocation(entity);
+    const Renderable* renderable = entities.GetComponent<Renderable>(entity);
+
+    // NOTE(Isaac): meshes that are still loading have nothing to draw yet
+    if (!location || !renderable || !renderable->mesh->loaded)
+    {
+      continue;
+    }
+
+    for (const EntityInstances::ArchetypeRange& range : instances.layout)
+    {
+      if (range.archetype == location->archetype)
+      {
+        batchItems.push_back(EntityBatchItem{renderable, range.firstTransform + location->row});
+        break;
+      }
+    }
+  }
+
+  /*
+   * Group the entities by mesh, then texture, so each batch is a contiguous range of instances. Within a batch,
+   * they're in the order their transforms are in, so the shader reads through them in order.
+   */
+  std::sort(batchItems.begin(), batchItems.end(),
+    [](const EntityBatchItem& a, const EntityBatchItem& b)
+    {
+      if (a.renderable->mesh != b.renderable->mesh)
+      {
+        return a.renderable->mesh.Get() < b.renderable->mesh.Get();
+      }
+
+      if (a.renderable->texture != b.renderable->texture)
+      {
+        return a.renderable->texture.Get() < b.renderable->texture.Get();
+      }
+
+      return a.transform < b.transform;
+    });
+
+  instances.draws.clear();
+  instances.indices.clear();
+  instances.batched = batchEntities;
+
+  unsigned int batchStart = 0u;
+  while (batchStart < batchItems.size())
+  {
+    Mesh* mesh = batchItems[batchStart].renderable->mesh.Get();
+    Texture* texture = batchItems[batchStart].renderable->texture.Get();
+    unsigned int batchEnd = batchStart + 1u;
+
+    if (batchEntities)
+    {
+      while (batchEnd < batchItems.size() &&
+             batchItems[batchEnd].renderable->mesh.Get() == mesh &&
+             batchItems[batchEnd].renderable->texture.Get() == texture)
+      {
+        batchEnd++;
+      }
+    }
+
+    DrawCommand command;
+    command.key                 = MakeSortKey(PASS_ENTITIES, entityShader[mesh->format]->handle, texture->handle, mesh->vao, 0u);
+    command.shader              = entityShader[mesh->format];
+    command.vao                 = mesh->vao;
+    command.texture             = texture->handle;
+    command.primitive           = GL_TRIANGLES;
+    command.indexType           = mesh->indexType;
+    command.count               = mesh->numElements;
+    command.instanceBuffer      = instances.indexBuffer;
+    command.instanceTransforms  = instances.transformTexture;
+    command.firstInstance       = instances.indices.size();
+    command.instanceCount       = batchEnd - batchStart;
+    command.mesh                = mesh;
+    instances.draws.push_back(command);
+
+    for (unsigned int i = batchStart;
+         i < batchEnd;
+         i++)
+    {
+      instances.indices.push_back(batchItems[i].transform);
+    }
+
+    batchStart = batchEnd;
+  }
+
+  if (instances.indices.empty())
+  {
+    return;
+  }
+
+  /*
+   * The index buffer is orphaned before it's refilled, so we never have to wait for the GPU to finish with the
+   * old batches.
+   */
+  const size_t size = instances.indices.size() * sizeof(GLuint);
+  glBindBuffer(GL_ARRAY_BUFFER, instances.indexBuffer);
+
+  if (instances.indices.size() > instances.indexCapacity)
+  {
+    instances.indexCapacity = instances.indices.size();
+  }
+
+  glBufferData(GL_ARRAY_BUFFER, instances.indexCapacity * sizeof(GLuint), nullptr, GL_DYNAMIC_DRAW);
+  glBufferSubData(GL_ARRAY_BUFFER, 0, size, instances.indices.data());
+  frameStats.bufferUploads++;
+  frameStats.uploadedBytes += size;
+}
+
+void Renderer::RecordEntities(CommandList& list, const EntityInstances& instances)
+{
+  list.commands.insert(list.commands.end(), instances.draws.begin(), instances.draws.end());
+}
+
+void Renderer::Submit(CommandList& list)
+{
+  std::lock_guard<std::mutex> guard(queueLock);
+  const unsigned int rangeBase = queue.ranges.size();
+
+  for (DrawCommand& command : list.commands)
+  {
+    command.firstRange += rangeBase;
+    queue.commands.push_back(command);
+  }
+
+  queue.ranges.insert(queue.ranges.end(), list.ranges.begin(), list.ranges.end());
+}
+
+/*
+ * Points the per-instance index attribute of the currently bound VAO at the instance buffer, starting at the
+ * given instance.
+ */
+static void SetInstanceAttributes(GLuint instanceBuffer, unsigned int firstInstance)
+{
+  glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+  glEnableVertexAttribArray(INSTANCE_INDEX_LOCATION);
+  glVertexAttribIPointer(INSTANCE_INDEX_LOCATION, 1, GL_UNSIGNED_INT, sizeof(GLuint), (const void*)(firstInstance * sizeof(GLuint)));
+  glVertexAttribDivisor(INSTANCE_INDEX_LOCATION, 1);
+}
+
+static size_t GetIndexSize(GLenum indexType)
+{
+  switch (indexType)
+  {
+    case GL_UNSIGNED_BYTE:  return sizeof(GLubyte);
+    case GL_UNSIGNED_SHORT: return sizeof(GLushort);
+    default:                return sizeof(GLuint);
+  }
+}
+
+void Renderer::Execute(const CommandList& list, const DrawCommand& command)
+{
+  unsigned int changes = 0u;
+  unsigned int skipped = 0u;
+  auto track = [&changes, &skipped](bool changed)
+    {
+      if (changed) changes++; else skipped++;
+    };
+
+  track(stateCache.BindProgram(command.shader->handle));
+  track(stateCache.BindVertexArray(command.vao));
+
+  if (command.texture)
+  {
+    track(stateCache.BindTexture(command.textureTarget, command.texture));
+  }
+
+  if (command.colorUniform != -1)
+  {
+    track(stateCache.SetColor(command.shader->handle, command.colorUniform, command.color));
+  }
+
+  if (command.instanceTransforms)
+  {
+    track(stateCache.BindInstanceTransforms(command.instanceTransforms));
+  }
+
+  if (command.mesh && command.mesh->format == VERTEX_FORMAT_PACKED)
+  {
+    track(stateCache.SetDequantisation(dequantisationScaleUniform, dequantisationOffsetUniform, command.mesh));
+  }
+
+  frameStats.stateChanges += changes;
+  frameStats.redundantStateChanges += skipped;
+
+  if (command.rangeCount > 0u)
+  {
+    multiDrawFirsts.clear();
+    multiDrawCounts.clear();
+    multiDrawOffsets.clear();
+
+    for (unsigned int i = command.firstRange;
+         i < command.firstRange + command.rangeCount;
+         i++)
+    {
+      multiDrawFirsts.push_back(list.ranges[i].first);
+      multiDrawCounts.push_back(list.ranges[i].count);
+      multiDrawOffsets.push_back((const void*)(list.ranges[i].first * GetIndexSize(command.indexType)));
+    }
+
+    if (command.indexType != GL_NONE)
+    {
+      glMultiDrawElements(command.primitive, multiDrawCounts.data(), command.indexType, multiDrawOffsets.data(), command.rangeCount);
+    }
+    else
+    {
+      glMultiDrawArrays(command.primitive, multiDrawFirsts.data(), multiDrawCounts.data(), command.rangeCount);
+    }
+  }
+  else if (command.instanceCount > 0u)
+  {
+    SetInstanceAttributes(command.instanceBuffer, command.firstInstance);
+    glDrawElementsInstanced(command.primitive, command.count, command.indexType, (const void*)(command.first * GetIndexSize(command.indexType)), command.instanceCount);
+    frameStats.instances += command.instanceCount;
+  }
+  else if (command.indexType != GL_NONE)
+  {
+    glDrawElements(command.primitive, command.count, command.indexType, (const void*)(command.first * GetIndexSize(command.indexType)));
+  }
+  else
+  {
+    glDrawArrays(command.primitive, command.first, command.count);
+  }
+
+  frameStats.drawCalls++;
 }
 
-void Renderer::RenderEntity(Entity* entity)
+void Renderer::ExecuteList(CommandList& list)
 {
-  const Renderable* renderable = entity->GetComponent<Renderable>();
-  assert(renderable);
+  // NOTE(Isaac): this needs to be stable, so draws with identical keys happen in the order they were recorded
+  std::stable_sort(list.commands.begin(), list.commands.end(),
+    [](const DrawCommand& a, const DrawCommand& b)
+    {
+      return a.key < b.key;
+    });
 
-  if (renderable)
+  stateCache.Reset();
+  for (const DrawCommand& command : list.commands)
   {
-    SetUniform(shader, "texture", *(renderable->texture));
-    SetUniform(shader, "model", CreateTransformation(entity->transform));
-    DrawMesh(*(renderable->mesh));
+    Execute(list, command);
   }
 }
 
+void Renderer::Flush()
+{
+  std::lock_guard<std::mutex> guard(queueLock);
+  auto flushStart = std::chrono::high_resolution_clock::now();
+
+  ExecuteList(queue);
+  queue.Clear();
+  frameStats.flushTime = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - flushStart).count();
+
+  // NOTE(Isaac): `stats` holds the last complete frame, so it can be shown while the next one is being recorded
+  stats = frameStats;
+  frameStats = RenderStats();
+}
+
+/*
+ * Unlike `Submit`, this executes the list straight away, so must be called from the render thread.
+ */
+void Renderer::RenderToTarget(RenderTarget& target, CommandList& list)
+{
+  glBindFramebuffer(GL_FRAMEBUFFER, target.framebuffer);
+  glViewport(0, 0, target.width, target.height);
+  glClear(GL_COLOR_BUFFER_BIT);
+
+  ExecuteList(list);
+
+  glBindFramebuffer(GL_FRAMEBUFFER, 0u);
+  glViewport(0, 0, width, height);
+}
+
+void Renderer::RecordFullscreenTexture(CommandList& list, RenderPass pass, GLuint texture)
+{
+  DrawCommand command;
+  command.key       = MakeSortKey(pass, compositeShader->handle, texture, emptyVAO, 0u);
+  command.shader    = compositeShader;
+  command.vao       = emptyVAO;
+  command.texture   = texture;
+  command.primitive = GL_TRIANGLES;
+  command.count     = 3u;
+  list.commands.push_back(command);
+}
+
 void Renderer::EndFrame()
 {
+  Flush();
   ImGui::Render();
   SwapWindowBuffer();
 }
@@ -5,21 +5,52 @@
 
 #pragma once
 
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <condition_variable>
+#include <initializer_list>
+#include <algorithm>
+#include <cstdint>
+#include <unordered_map>
 #include <gl3w.hpp>
 #include <maths.hpp>
+#include <platform.hpp>
+#include <archive.hpp>
 #include <asset.hpp>
 #include <entity.hpp>
+#include <spatial.hpp>
 
 // --- Mesh ---
 struct Mesh
 {
+  Mesh();                           // NOTE(Isaac): an empty mesh, to be filled in by a `MeshLoader`
   Mesh(const MeshData& meshData);
+  Mesh(const char* cookedPath);     // NOTE(Isaac): loads the mesh straight away, on the calling thread
   ~Mesh();
 
   unsigned int numElements;
+  float boundingRadius;     // Of a sphere around the origin enclosing every vertex
+  VertexFormatType format;
+  GLenum indexType;
+  /*
+   * Takes positions from the vertex buffer back into the mesh's space (`position * scale + offset`). For packed
+   * meshes, these are set as uniforms when the mesh is drawn, so the instances' transforms can be used as they are.
+   */
+  Vec<3u> dequantisationScale;
+  Vec<3u> dequantisationOffset;
+  /*
+   * Every part of the mesh lives in the same buffers, so the whole thing can still be drawn in one go (which is
+   * what we do while entities only have one texture).
+   */
+  std::vector<Submesh> submeshes;
   GLuint vao;
   GLuint vbo;
   GLuint ebo;
+  bool loaded;                      // NOTE(Isaac): until this is set, there's nothing to draw
 };
 
 void DrawMesh(Mesh& mesh);
@@ -27,38 +58,674 @@ void DrawMesh(Mesh& mesh);
 // --- Shaders ---
 struct Shader
 {
-  Shader(const char* basePath);
+  Shader();                       // NOTE(Isaac): an empty shader, which is built later by a `ShaderCompiler`
+  Shader(const char* basePath);   // NOTE(Isaac): builds the shader straight away, on the calling thread
   ~Shader();
 
   GLuint        handle;
   unsigned int  textureCount;
+  float         loadTime;     // NOTE(Isaac): how long it took to create the program (ms)
+  bool          fromCache;    // NOTE(Isaac): whether the program was restored from the binary cache
+
+  /*
+   * Set once the program has been linked and reflected. Shaders built by a `ShaderCompiler` can't be used
+   * until this is set (`GetVariant` waits for it).
+   */
+  std::atomic<bool> ready;
+
+  /*
+   * These are reflected from the program once it's been linked, so looking up a uniform never has to go to
+   * the driver. Uniforms that live in blocks aren't included in `uniforms`.
+   */
+  std::unordered_map<std::string, GLint>  uniforms;
+  std::unordered_map<std::string, GLuint> uniformBlocks;
 };
 
 void UseShader(Shader& shader);
-template<typename T> void SetUniform(Shader& shader, const char* name, const T& value);
+
+/*
+ * Uniforms should be resolved to a location once (e.g. when the thing using the shader is created), and then
+ * set by location. Returns -1 if the shader doesn't have an active uniform called `name`, which is safe to set.
+ */
+GLint GetUniformLocation(const Shader& shader, const char* name);
+template<typename T> void SetUniform(Shader& shader, GLint location, const T& value);
+void BindUniformBlock(Shader& shader, const char* name, GLuint bindingPoint);
+
+/*
+ * A shader that's built from the same sources with different sets of features turned on. Each feature is
+ * `#define`d at the top of both stages, and the sources use `#ifdef` to pick what they need. Each combination
+ * of features (a variant) is only compiled when it's asked for, or ahead of time with `Precompile`.
+ */
+typedef uint32_t ShaderFeatures;
+#define MAX_SHADER_FEATURES 32u
+
+struct ShaderPermutations
+{
+  ShaderPermutations(const char* basePath, std::initializer_list<const char*> features);
+  ~ShaderPermutations();
+
+  std::string                                 basePath;
+  std::vector<std::string>                    features;
+  std::unordered_map<ShaderFeatures, Shader*> variants;
+};
+
+ShaderFeatures GetShaderFeature(const ShaderPermutations& permutations, const char* name);
+
+/*
+ * Builds shader variants without stalling the thread that asks for them. Where the driver supports
+ * `KHR_parallel_shader_compile`, we kick off every compile and link at once and let the driver's threads get on
+ * with it, checking back each frame. Otherwise, they're built on a worker thread with its own shared context.
+ * If we can't have one of those either, we build one variant per frame on the main thread.
+ */
+struct ShaderBuild;
+struct SharedGLContext;
+
+struct ShaderCompiler
+{
+  ShaderCompiler();
+  ~ShaderCompiler();
+
+  /*
+   * Starts building the given variants, if they haven't been already.
+   */
+  void Precompile(ShaderPermutations& permutations, std::initializer_list<ShaderFeatures> variants);
+
+  /*
+   * Returns the variant with the given features, which is ready to use. If it hasn't finished building yet,
+   * this waits for it.
+   */
+  Shader* GetVariant(ShaderPermutations& permutations, ShaderFeatures features);
+
+  /*
+   * Finishes off any builds that are done. Should be called once a frame, on the main thread.
+   */
+  void Update();
+
+  unsigned int NumPending();
+
+private:
+  enum Mode
+  {
+    PARALLEL_DRIVER,    // NOTE(Isaac): `KHR_parallel_shader_compile`
+    WORKER_THREAD,
+    MAIN_THREAD,
+  };
+
+  Mode                      mode;
+  std::vector<ShaderBuild*> pending;      // NOTE(Isaac): in `WORKER_THREAD` mode, these belong to the worker
+  std::mutex                pendingLock;
+  std::condition_variable   pendingChanged;
+  std::thread               worker;
+  bool                      quit;
+  SharedGLContext*          workerContext;
+
+  Shader* Enqueue(ShaderPermutations& permutations, ShaderFeatures features);
+  void WorkerMain();
+};
+
+// --- Uniform buffers ---
+enum UniformBlockBinding : GLuint
+{
+  FRAME_UNIFORMS_BINDING = 0u,
+};
+
+/*
+ * Data that only changes once per frame. This must match the layout of the std140 `FrameUniforms` block in
+ * the shaders.
+ */
+struct FrameUniforms
+{
+  Mat<4u> projection;
+};
 
 // --- Textures ---
 struct Texture
 {
-  Texture(const char* path);
+  Texture();                        // NOTE(Isaac): an empty texture, to be filled in by a `TextureLoader`
+  Texture(const char* cookedPath);  // NOTE(Isaac): loads the texture straight away, on the calling thread
   ~Texture();
 
   GLuint handle;
   unsigned int width;
   unsigned int height;
+  bool loaded;                      // NOTE(Isaac): until this is set, `handle` is a placeholder we don't own
+};
+
+/*
+ * Loads cooked textures (see `CookedTextureHeader`) without stalling the frame. Files are opened (see
+ * `OpenFile`) and paged in by the job system, and then every mip level is streamed to the GPU through a small
+ * pool of pixel buffer objects, a few rows at a time, so each frame only uploads up to `TEXTURE_UPLOAD_BUDGET`
+ * bytes. Until a texture has finished uploading, it uses a placeholder, so it can be drawn with straight away.
+ *
+ * NOTE(Isaac): textures must outlive their loads.
+ */
+#define TEXTURE_UPLOAD_BUDGET (4u * 1024u * 1024u)    // NOTE(Isaac): in bytes per frame
+#define NUM_PIXEL_BUFFERS     4u
+
+struct JobSystem;
+struct RenderStats;
+
+struct TextureLoader
+{
+  TextureLoader(JobSystem& jobs);
+  ~TextureLoader();
+
+  void Load(Texture& texture, const char* cookedPath);
+
+  /*
+   * Uploads as much as the budget allows. Should be called once a frame, on the main thread.
+   */
+  void Update(RenderStats& stats);
+
+  unsigned int NumPending();
+
+private:
+  struct PendingTexture
+  {
+    Texture*                    texture;
+    std::string                 path;
+    FileView                    file;
+    const CookedTextureHeader*  header;     // NOTE(Isaac): points into `file`, or nullptr if it couldn't be loaded
+    GLuint                      handle;
+    unsigned int                level;      // NOTE(Isaac): the mip that's being uploaded
+    unsigned int                nextRow;    // NOTE(Isaac): the first row of `level` that hasn't been uploaded yet
+  };
+
+  JobSystem&                  jobs;
+  GLuint                      placeholder;
+  GLuint                      pixelBuffers[NUM_PIXEL_BUFFERS];
+  unsigned int                nextPixelBuffer;
+
+  std::mutex                  mappedLock;
+  std::vector<PendingTexture> mapped;     // NOTE(Isaac): filled by the workers, and drained by `Update`
+  std::deque<PendingTexture>  uploads;
+  unsigned int                numMapping;
+};
+
+// --- Mesh loader ---
+/*
+ * Loads cooked meshes without stalling the frame. The files are opened (see `OpenFile`) and paged in by the
+ * job system, so all that's left for the main thread is handing the buffers to GL, which it does in `Update`.
+ *
+ * NOTE(Isaac): meshes must outlive their loads.
+ */
+struct MeshLoader
+{
+  MeshLoader(JobSystem& jobs);
+  ~MeshLoader();
+
+  void Load(Mesh& mesh, const char* cookedPath);
+
+  /*
+   * Creates the buffers of every mesh that's been mapped since the last call, and returns whether there were
+   * any. Should be called once a frame, on the main thread.
+   */
+  bool Update();
+
+  unsigned int NumPending();
+
+private:
+  struct PendingMesh
+  {
+    Mesh*                   mesh;
+    std::string             path;
+    FileView                file;
+    const CookedMeshHeader* header;     // NOTE(Isaac): points into `file`, or nullptr if it couldn't be loaded
+  };
+
+  JobSystem&                jobs;
+  std::mutex                mappedLock;
+  std::vector<PendingMesh>  mapped;     // NOTE(Isaac): filled by the workers, and drained by `Update`
+  unsigned int              numMapping;
+};
+
+// --- Asset registry ---
+/*
+ * Owns every mesh and texture the game has loaded, and hands out `AssetHandle`s to them. Loading something
+ * that's already loaded just returns another handle to it, and everything is loaded in parallel by the job
+ * system. Assets are unloaded as soon as their last handle is destroyed (or, if they're still loading, as soon
+ * as they've finished), so handles mustn't outlive the registry.
+ */
+struct AssetRegistry
+{
+  AssetRegistry(JobSystem& jobs);
+  ~AssetRegistry();
+
+  MeshHandle LoadMesh(const std::string& cookedPath);
+  TextureHandle LoadTexture(const std::string& cookedPath);
+
+  /*
+   * Finishes off any loads that the job system is done with, and streams textures to the GPU. Returns whether
+   * any meshes finished loading (because their bounds might not have been known until now).
+   */
+  bool Update(RenderStats& stats);
+
+  unsigned int NumPending();
+  unsigned int NumMeshes() const;
+  unsigned int NumTextures() const;
+
+  unsigned int numDeduplicated;   // NOTE(Isaac): how many loads were served by an asset that was already loaded
+
+private:
+  friend void ReleaseAsset(AssetSlot<Mesh>* slot);
+  friend void ReleaseAsset(AssetSlot<Texture>* slot);
+
+  MeshLoader                                            meshLoader;
+  TextureLoader                                         textureLoader;
+  std::unordered_map<std::string, AssetSlot<Mesh>*>     meshes;
+  std::unordered_map<std::string, AssetSlot<Texture>*>  textures;
+  /*
+   * Assets that lost their last handle while they were still loading. The loaders still have pointers to them,
+   * so they're kept around until there's nothing left to load.
+   */
+  std::vector<Mesh*>                                    orphanedMeshes;
+  std::vector<Texture*>                                 orphanedTextures;
+};
+
+// --- Render targets ---
+/*
+ * An offscreen framebuffer with a single color attachment that can be sampled afterwards.
+ */
+struct RenderTarget
+{
+  RenderTarget();
+  ~RenderTarget();
+
+  void Resize(unsigned int width, unsigned int height);
+
+  GLuint        framebuffer;
+  GLuint        colorTexture;
+  unsigned int  width;
+  unsigned int  height;
+};
+
+// --- Render queue ---
+enum RenderPass : uint8_t
+{
+  PASS_CELLS,
+  PASS_WORLD,
+  PASS_ENTITIES,
+  NUM_PASSES
+};
+
+/*
+ * Commands are executed in the order of their sort keys, so that draws sharing state end up next to each other.
+ * From most to least significant, a key is made up of:
+ *    [63..60] pass   [59..52] shader   [51..40] texture   [39..24] mesh   [23..0] depth
+ */
+uint64_t MakeSortKey(RenderPass pass, GLuint shader, GLuint texture, GLuint vao, unsigned int depth);
+
+struct DrawCommand
+{
+  DrawCommand()
+    :key(0u)
+    ,shader(nullptr)
+    ,vao(0u)
+    ,texture(0u)
+    ,textureTarget(GL_TEXTURE_2D)
+    ,primitive(GL_TRIANGLES)
+    ,indexType(GL_NONE)
+    ,first(0u)
+    ,count(0u)
+    ,instanceBuffer(0u)
+    ,instanceTransforms(0u)
+    ,firstInstance(0u)
+    ,instanceCount(0u)
+    ,mesh(nullptr)
+    ,firstRange(0u)
+    ,rangeCount(0u)
+    ,colorUniform(-1)
+    ,color()
+  { }
+
+  uint64_t      key;
+  Shader*       shader;
+  GLuint        vao;
+  GLuint        texture;        // Bound to unit 0, or 0 to leave the texture alone
+  GLenum        textureTarget;
+  GLenum        primitive;
+  GLenum        indexType;      // GL_NONE for non-indexed draws
+  unsigned int  first;          // First vertex, or first index for indexed draws
+  unsigned int  count;
+  GLuint        instanceBuffer;       // Holds an index into `instanceTransforms` for each instance
+  GLuint        instanceTransforms;   // A buffer texture of transforms, which is bound to unit 1
+  unsigned int  firstInstance;        // Into `instanceBuffer`
+  unsigned int  instanceCount;        // 0 for non-instanced draws
+  const Mesh*   mesh;                 // If it's packed, its dequantisation is set before it's drawn
+  /*
+   * If this isn't 0, `first` and `count` are ignored, and the draw is instead made up of these ranges of the
+   * list's `ranges` (which are drawn with a single multi-draw call).
+   */
+  unsigned int  firstRange;
+  unsigned int  rangeCount;
+  GLint         colorUniform;   // -1 if the draw doesn't need a color
+  Vec<4u>       color;
+};
+
+/*
+ * Commands are recorded into a CommandList, which is owned by a single thread, and then submitted to the
+ * Renderer. Any number of threads can record and submit lists at the same time, but only the render thread
+ * executes them.
+ */
+struct CommandList
+{
+  CommandList()
+    :commands()
+    ,ranges()
+  { }
+
+  void Clear()
+  {
+    commands.clear();
+    ranges.clear();
+  }
+
+  std::vector<DrawCommand>  commands;
+  std::vector<ItemRange>    ranges;               // In vertices, or indices for indexed draws
+};
+
+/*
+ * Shadows the bits of GL state we change while executing commands, so that we can skip setting state that's
+ * already set. This must be reset whenever something else might have touched the state (e.g. ImGui).
+ */
+struct GLStateCache
+{
+  GLStateCache();
+
+  void Reset();
+  bool BindProgram(GLuint program);
+  bool BindVertexArray(GLuint vao);
+  bool BindTexture(GLenum target, GLuint texture);
+  bool BindInstanceTransforms(GLuint texture);
+  bool SetColor(GLuint program, GLint location, const Vec<4u>& color);
+  bool SetDequantisation(GLint scaleLocation, GLint offsetLocation, const Mesh* mesh);
+
+  GLuint                                  program;
+  GLuint                                  vao;
+  GLuint                                  texture;
+  GLenum                                  textureTarget;
+  GLuint                                  instanceTransforms;
+  std::unordered_map<uint64_t, Vec<4u>>   colors;   // Keyed by (program << 32 | location)
+  const Mesh*                             dequantisedMesh;  // NOTE(Isaac): the packed shader's uniforms are set for this
+};
+
+// --- Camera ---
+/*
+ * A 2D camera looking down on the map. `position` is the point in the world at the bottom-left of the view, and
+ * `zoom` is how many pixels one unit of the world covers.
+ */
+struct Camera
+{
+  Camera(float viewWidth, float viewHeight);
+
+  void Pan(const Vec<2u>& pixels);
+  void ZoomAt(const Vec<2u>& windowPoint, float factor);    // NOTE(Isaac): window coordinates are from the top-left
+  Vec<2u> WindowToWorld(const Vec<2u>& windowPoint) const;
+  Rect GetViewBounds() const;
+  Mat<4u> GetProjection() const;
+
+  Vec<2u> position;
+  float   zoom;
+  float   viewWidth;
+  float   viewHeight;
 };
 
 // --- Rendering ---
+/*
+ * Each instance has an index into the draw's instance transforms, as an integer vertex attribute at this
+ * location. The transforms themselves are fetched from a buffer texture, on this texture unit.
+ */
+#define INSTANCE_INDEX_LOCATION 4u
+#define INSTANCE_TRANSFORMS_UNIT 1u
+
+struct RenderStats
+{
+  RenderStats()
+    :drawCalls(0u)
+    ,instances(0u)
+    ,stateChanges(0u)
+    ,redundantStateChanges(0u)
+    ,bufferUploads(0u)
+    ,uploadedBytes(0u)
+    ,flushTime(0.0f)
+  { }
+
+  unsigned int drawCalls;
+  unsigned int instances;
+  unsigned int stateChanges;
+  unsigned int redundantStateChanges;   // Skipped by the state cache
+  unsigned int bufferUploads;
+  unsigned int uploadedBytes;
+  float        flushTime;               // CPU time spent sorting and executing commands (ms)
+};
+
+// --- Streamed buffers ---
+/*
+ * Dirty elements that are at most this far apart are uploaded together, as re-uploading a few clean elements is
+ * cheaper than making another call.
+ */
+#define STREAMED_BUFFER_MERGE_GAP 8u
+
+/*
+ * A buffer that keeps a copy of its contents on the CPU, and is edited a few elements at a time. Edits are
+ * tracked as dirty ranges, which are coalesced into a few glBufferSubData calls by `Upload`, so the cost of an
+ * upload depends on how much has changed rather than on the size of the buffer.
+ */
+template<typename T>
+struct StreamedBuffer
+{
+  StreamedBuffer(GLenum target)
+    :target(target)
+    ,handle(0u)
+    ,elements()
+    ,dirtyRanges()
+  { }
+
+  ~StreamedBuffer()
+  {
+    glDeleteBuffers(1, &handle);
+  }
+
+  StreamedBuffer(const StreamedBuffer&) = delete;
+  StreamedBuffer& operator=(const StreamedBuffer&) = delete;
+
+  void Create(const std::vector<T>& initialElements)
+  {
+    elements = initialElements;
+    dirtyRanges.clear();
+
+    glGenBuffers(1, &handle);
+    glBindBuffer(target, handle);
+    glBufferData(target, elements.size() * sizeof(T), elements.data(), GL_DYNAMIC_DRAW);
+  }
+
+  const T& Get(unsigned int i) const
+  {
+    return elements[i];
+  }
+
+  bool IsDirty() const
+  {
+    return !dirtyRanges.empty();
+  }
+
+  void Set(unsigned int i, const T& value)
+  {
+    elements[i] = value;
+
+    if (!dirtyRanges.empty() && (dirtyRanges.back().first + dirtyRanges.back().count) == i)
+    {
+      dirtyRanges.back().count++;
+    }
+    else
+    {
+      dirtyRanges.push_back(ItemRange{i, 1u});
+    }
+  }
+
+  void Upload(RenderStats& stats)
+  {
+    if (dirtyRanges.empty())
+    {
+      return;
+    }
+
+    std::sort(dirtyRanges.begin(), dirtyRanges.end(),
+      [](const ItemRange& a, const ItemRange& b)
+      {
+        return a.first < b.first;
+      });
+
+    glBindBuffer(target, handle);
+    ItemRange current = dirtyRanges[0u];
+
+    auto uploadRange = [this, &stats](const ItemRange& range)
+      {
+        glBufferSubData(target, range.first * sizeof(T), range.count * sizeof(T), &(elements[range.first]));
+        stats.bufferUploads++;
+        stats.uploadedBytes += range.count * sizeof(T);
+      };
+
+    for (unsigned int i = 1u;
+         i < dirtyRanges.size();
+         i++)
+    {
+      const ItemRange& next = dirtyRanges[i];
+      unsigned int currentEnd = current.first + current.count;
+
+      if (next.first <= currentEnd + STREAMED_BUFFER_MERGE_GAP)
+      {
+        current.count = std::max(currentEnd, next.first + next.count) - current.first;
+      }
+      else
+      {
+        uploadRange(current);
+        current = next;
+      }
+    }
+
+    uploadRange(current);
+    dirtyRanges.clear();
+  }
+
+  GLenum                  target;
+  GLuint                  handle;
+  std::vector<T>          elements;
+  std::vector<ItemRange>  dirtyRanges;
+};
+
+/*
+ * An entity that's being sorted into batches by `Renderer::BatchEntities`.
+ */
+struct EntityBatchItem
+{
+  const Renderable* renderable;
+  GLuint            transform;    // NOTE(Isaac): its index in `EntityInstances::transformBuffer`
+};
+
+/*
+ * Entities are drawn with their `LocalToWorld`s straight out of their chunks: each chunk's column of them is
+ * copied into a range of one buffer (which is read by the shader as a buffer texture), and only when they've
+ * changed. Each batch of entities that share a mesh and texture is then drawn with a list of indices into it.
+ * The batches are only worked out again when the entities, or the view, change, so entities that don't move
+ * cost nothing but their draw calls.
+ *
+ * NOTE(Isaac): these own GL objects, so must only be used from the render thread.
+ */
+struct EntityInstances
+{
+  EntityInstances();
+  ~EntityInstances();
+
+  EntityInstances(const EntityInstances&) = delete;
+  EntityInstances& operator=(const EntityInstances&) = delete;
+
+  /*
+   * Each archetype's chunks are laid out one after another, with room for a full chunk each, so an entity's
+   * transform is at `firstTransform + row`. If the chunks change, everything is laid out and uploaded again.
+   */
+  struct ArchetypeRange
+  {
+    Archetype*        archetype;
+    unsigned int      firstTransform;
+    unsigned int      numChunks;
+  };
+
+  GLuint                        transformBuffer;
+  GLuint                        transformTexture;
+  unsigned int                  transformCapacity;  // In transforms, not bytes
+  GLuint                        indexBuffer;
+  unsigned int                  indexCapacity;      // In indices, not bytes
+  std::vector<ArchetypeRange>   layout;
+
+  std::vector<DrawCommand>      draws;
+  bool                          batched;            // Whether `draws` were batched (see `Renderer::batchEntities`)
+  std::vector<EntityBatchItem>  batchItems;         // NOTE(Isaac): scratch space, for sorting into batches
+  std::vector<GLuint>           indices;            // NOTE(Isaac): scratch space, uploaded to `indexBuffer`
+};
+
 struct Renderer
 {
   Renderer(unsigned int width, unsigned int height);
+  ~Renderer();
 
   void StartFrame();
-  void RenderEntity(Entity* entity);
+
+  /*
+   * These must be called from the render thread. `UpdateEntityTransforms` uploads the transforms of the chunks
+   * whose `LocalToWorld`s have changed (and clears their flags). It returns whether the transforms had to be
+   * laid out again, in which case the batches need working out again too (with `BatchEntities`).
+   */
+  bool UpdateEntityTransforms(EntityInstances& instances, EntityManager& entities);
+  void BatchEntities(EntityInstances& instances, EntityManager& entities, const std::vector<Entity>& visible);
+
+  /*
+   * Unlike the others, this can be called from any thread, because it only copies the batches' draws.
+   */
+  void RecordEntities(CommandList& list, const EntityInstances& instances);
+  void Submit(CommandList& list);
+  void RenderToTarget(RenderTarget& target, CommandList& list);
+  void RecordFullscreenTexture(CommandList& list, RenderPass pass, GLuint texture);
   void EndFrame();
 
   unsigned int  width;
   unsigned int  height;
-  Shader        shader;
+  ShaderPermutations  worldShaders;     // NOTE(Isaac): the map's layers, optionally coloured per-cell
+  ShaderPermutations  entityShaders;
+  ShaderPermutations  compositeShaders;
+  ShaderCompiler      shaderCompiler;   // NOTE(Isaac): after the permutations, so it's destroyed first
+  Shader*       shader;
+  Shader*       entityShader[NUM_VERTEX_FORMATS];   // NOTE(Isaac): the variant for each vertex format
+  Shader*       cellShader;
+  Shader*       compositeShader;
+  Camera        camera;
   Mat<4u>       projection;
+  GLuint        frameUBO;
+
+  GLint         colorUniform;
+  GLint         cellColorsUniform;
+  GLint         dequantisationScaleUniform;   // NOTE(Isaac): of the packed entity shader
+  GLint         dequantisationOffsetUniform;
+  GLuint        emptyVAO;
+
+  /*
+   * If this is set, entities that share a mesh and texture are drawn together with one instanced draw call.
+   * Otherwise, each entity is drawn on its own (this is mainly useful for comparison).
+   */
+  bool          batchEntities;
+  RenderStats   stats;          // NOTE(Isaac): from the last complete frame
+  RenderStats   frameStats;     // NOTE(Isaac): being collected for the frame that's being recorded
+
+private:
+  std::mutex                queueLock;
+  CommandList               queue;
+  GLStateCache              stateCache;
+
+  std::vector<GLint>        multiDrawFirsts;
+  std::vector<GLsizei>      multiDrawCounts;
+  std::vector<const void*>  multiDrawOffsets;
+
+  void ExecuteList(CommandList& list);
+  void Flush();
+  void Execute(const CommandList& list, const DrawCommand& command);
 };
@@ -0,0 +1,177 @@
+/*
+ * Copyright (C) 2017, Isaac Woods.
+ * See LICENCE.md
+ */
+
+#include <scheduler.hpp>
+
+SystemScheduler::SystemScheduler(JobSystem& jobs)
+  :jobs(jobs)
+  ,group()
+  ,systems()
+  ,delta(0.0f)
+{
+}
+
+SystemScheduler::~SystemScheduler()
+{
+  for (ScheduledSystem* system : systems)
+  {
+    delete system;
+  }
+}
+
+static bool DoSystemsConflict(const System& a, const System& b)
+{
+  return (a.writes & b.query).any() || (b.writes & a.query).any();
+}
+
+/*
+ * Systems are only ever added to the end, so we only need to look for the earlier systems the new one conflicts
+ * with. This means the dependencies always point forwards, so they can't form a cycle.
+ */
+void SystemScheduler::AddSystem(System system)
+{
+  ScheduledSystem* scheduled = new ScheduledSystem;
+  scheduled->system = std::move(system);
+  scheduled->numDependencies = 0u;
+  unsigned int index = static_cast<unsigned int>(systems.size());
+
+  for (ScheduledSystem* other : systems)
+  {
+    if (DoSystemsConflict(other->system, scheduled->system))
+    {
+      other->dependents.push_back(index);
+      scheduled->numDependencies++;
+    }
+  }
+
+  systems.push_back(scheduled);
+}
+
+Signature SystemScheduler::Run(EntityManager& entities, float delta)
+{
+  this->delta = delta;
+  Signature written;
+
+  // Split each system's entities into batches, before anything starts running
+  for (ScheduledSystem* scheduled : systems)
+  {
+    const Signature& query = scheduled->system.query;
+    scheduled->batches.clear();
+
+    for (Archetype* archetype : entities.GetArchetypes())
+    {
+      if ((archetype->signature & query) != query)
+      {
+        continue;
+      }
+
+      unsigned int batchSize = 0u;
+      for (unsigned int i = 0u;
+           i < archetype->chunks.size();
+           i++)
+      {
+        if (batchSize == 0u)
+        {
+          scheduled->batches.push_back(Batch{archetype, i, 0u});
+        }
+
+        scheduled->batches.back().numChunks++;
+        batchSize += archetype->chunks[i].count;
+
+        if (batchSize >= SYSTEM_BATCH_SIZE)
+        {
+          batchSize = 0u;
+        }
+      }
+    }
+
+    if (!scheduled->batches.empty())
+    {
+      written |= scheduled->system.writes;
+    }
+
+    scheduled->dependenciesLeft = scheduled->numDependencies;
+    scheduled->batchesLeft = static_cast<unsigned int>(scheduled->batches.size());
+  }
+
+  for (unsigned int i = 0u;
+       i < systems.size();
+       i++)
+  {
+    if (systems[i]->numDependencies == 0u)
+    {
+      StartSystem(i);
+    }
+  }
+
+  jobs.Wait(group);
+
+  // NOTE(Isaac): this is done afterwards, rather than in the jobs, because systems that can run at the same time
+  // might share chunks
+  for (ScheduledSystem* scheduled : systems)
+  {
+    for (const Batch& batch : scheduled->batches)
+    {
+      for (unsigned int i = batch.firstChunk;
+           i < batch.firstChunk + batch.numChunks;
+           i++)
+      {
+        batch.archetype->chunks[i].changed |= scheduled->system.writes;
+      }
+    }
+  }
+
+  return written;
+}
+
+unsigned int SystemScheduler::NumSystems() const
+{
+  return static_cast<unsigned int>(systems.size());
+}
+
+void SystemScheduler::StartSystem(unsigned int index)
+{
+  ScheduledSystem* scheduled = systems[index];
+
+  // NOTE(Isaac): with nothing to run over, there'd be no batch to finish the system, so we do it here
+  if (scheduled->batches.empty())
+  {
+    FinishSystem(index);
+    return;
+  }
+
+  for (const Batch& batch : scheduled->batches)
+  {
+    jobs.Submit([this, scheduled, index, &batch]()
+      {
+        for (unsigned int i = batch.firstChunk;
+             i < batch.firstChunk + batch.numChunks;
+             i++)
+        {
+          scheduled->system.run(delta, *(batch.archetype), batch.archetype->chunks[i]);
+        }
+
+        if (--(scheduled->batchesLeft) == 0u)
+        {
+          FinishSystem(index);
+        }
+      }, group);
+  }
+}
+
+/*
+ * Starts any of the system's dependents that were only waiting for this one. This happens on whichever thread
+ * finished the system's last batch.
+ */
+void SystemScheduler::FinishSystem(unsigned int index)
+{
+  for (unsigned int dependent : systems[index]->dependents)
+  {
+    if (--(systems[dependent]->dependenciesLeft) == 0u)
+    {
+      StartSystem(dependent);
+    }
+  }
+}
@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2017, Isaac Woods.
+ * See LICENCE.md
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <functional>
+#include <type_traits>
+#include <entity.hpp>
+#include <jobs.hpp>
+
+/*
+ * Each system's entities are split into batches of at least this many, which are run as separate jobs. Smaller
+ * batches spread the work out more evenly, but every job has a cost to hand out.
+ */
+#define SYSTEM_BATCH_SIZE 1024u
+
+/*
+ * A system is run over every entity with the components it asks for. It has to say which of them it writes
+ * (everything else is only read), so the scheduler knows which systems can safely run at the same time.
+ */
+struct System
+{
+  std::string name;
+  Signature   query;    // Every component it needs
+  Signature   writes;
+  std::function<void(float, const Archetype&, const Chunk&)> run;
+};
+
+/*
+ * Runs systems in parallel on the job system. Two systems conflict if either of them writes something the other
+ * one reads or writes, and conflicting systems run in the order they were added - the rest run whenever they're
+ * ready. Within a system, the entities are split into batches that can run on different threads.
+ *
+ * Systems mustn't create or destroy entities, or add or remove components.
+ */
+struct SystemScheduler
+{
+  SystemScheduler(JobSystem& jobs);
+  ~SystemScheduler();
+
+  SystemScheduler(const SystemScheduler&) = delete;
+  SystemScheduler& operator=(const SystemScheduler&) = delete;
+
+  /*
+   * Calls `function(delta, entity, components...)` for every entity with all of the given components.
+   * Components the system only reads should be asked for as `const`.
+   */
+  template<typename... Ts, typename F>
+  void Add(const std::string& name, F function)
+  {
+    static_assert(sizeof...(Ts) > 0u, "Systems need at least one type of component to run over");
+
+    System system;
+    system.name = name;
+    system.query = MakeSignature<Ts...>();
+    // NOTE(Isaac): anything that isn't `const` is assumed to be written to
+    ((std::is_const<Ts>::value ? system.writes : system.writes.set(GetComponentId<Ts>())), ...);
+    system.run = [function](float delta, const Archetype& archetype, const Chunk& chunk)
+      {
+        auto forEntity = [&](Entity entity, Ts&... components)
+          {
+            function(delta, entity, components...);
+          };
+
+        ForEachInChunk<Ts...>(archetype, chunk, forEntity);
+      };
+
+    AddSystem(std::move(system));
+  }
+
+  /*
+   * Runs every system once, and waits for them all to finish. Returns the components that might have been
+   * written to (by the systems that had any entities to run over), which are also marked as changed in the
+   * chunks they ran over.
+   */
+  Signature Run(EntityManager& entities, float delta);
+
+  unsigned int NumSystems() const;
+
+private:
+  struct Batch
+  {
+    Archetype*    archetype;
+    unsigned int  firstChunk;
+    unsigned int  numChunks;
+  };
+
+  /*
+   * The dependencies only change when a system is added, but the batches are worked out again every time the
+   * systems are run, because the entities might have moved between chunks.
+   */
+  struct ScheduledSystem
+  {
+    System                    system;
+    std::vector<unsigned int> dependents;       // Systems that can't start until this one has finished
+    unsigned int              numDependencies;
+    std::vector<Batch>        batches;
+    std::atomic<unsigned int> dependenciesLeft;
+    std::atomic<unsigned int> batchesLeft;
+  };
+
+  JobSystem&                    jobs;
+  JobGroup                      group;
+  std::vector<ScheduledSystem*> systems;
+  float                         delta;
+
+  void AddSystem(System system);
+  void StartSystem(unsigned int index);
+  void FinishSystem(unsigned int index);
+};
@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2017, Isaac Woods.
+ * See LICENCE.md
+ */
+
+#include <spatial.hpp>
+#include <algorithm>
+#include <cmath>
+
+UniformGrid::UniformGrid()
+  :bounds()
+  ,columns(1u)
+  ,rows(1u)
+  ,bucketSize()
+  ,bucketStarts()
+{
+}
+
+UniformGrid::UniformGrid(const Rect& bounds, unsigned int numItemsHint, unsigned int itemsPerBucket)
+  :bounds(bounds)
+  ,columns(1u)
+  ,rows(1u)
+  ,bucketSize()
+  ,bucketStarts()
+{
+  // Pick roughly square buckets, so that on average each one holds `itemsPerBucket` items
+  Vec<2u> size = bounds.max - bounds.min;
+  float numBuckets = std::max(1.0f, static_cast<float>(numItemsHint) / static_cast<float>(itemsPerBucket));
+  float aspect = size.x() / size.y();
+
+  columns     = std::max(1u, static_cast<unsigned int>(sqrtf(numBuckets * aspect)));
+  rows        = std::max(1u, static_cast<unsigned int>(sqrtf(numBuckets / aspect)));
+  bucketSize  = size / Vec<2u>(static_cast<float>(columns), static_cast<float>(rows));
+}
+
+unsigned int UniformGrid::BucketOf(const Vec<2u>& position) const
+{
+  Vec<2u> cell = (position - bounds.min) / bucketSize;
+  int x = std::min(std::max(static_cast<int>(cell.x()), 0), static_cast<int>(columns) - 1);
+  int y = std::min(std::max(static_cast<int>(cell.y()), 0), static_cast<int>(rows) - 1);
+  return static_cast<unsigned int>(y) * columns + static_cast<unsigned int>(x);
+}
+
+void UniformGrid::Build(const std::vector<unsigned int>& itemBuckets, std::vector<unsigned int>& order)
+{
+  // This is a counting sort, so it's linear in the number of items and buckets
+  bucketStarts.assign(columns * rows + 1u, 0u);
+
+  for (unsigned int bucket : itemBuckets)
+  {
+    bucketStarts[bucket + 1u]++;
+  }
+
+  for (unsigned int i = 1u;
+       i < bucketStarts.size();
+       i++)
+  {
+    bucketStarts[i] += bucketStarts[i - 1u];
+  }
+
+  std::vector<unsigned int> next(bucketStarts.begin(), bucketStarts.end() - 1);
+  order.resize(itemBuckets.size());
+
+  for (unsigned int i = 0u;
+       i < itemBuckets.size();
+       i++)
+  {
+    order[next[itemBuckets[i]]++] = i;
+  }
+}
+
+void UniformGrid::Query(const Rect& rect, std::vector<ItemRange>& ranges) const
+{
+  if (bucketStarts.empty() ||
+      rect.max.x() < bounds.min.x() || rect.max.y() < bounds.min.y() ||
+      rect.min.x() > bounds.max.x() || rect.min.y() > bounds.max.y())
+  {
+    return;
+  }
+
+  unsigned int minBucket = BucketOf(rect.min);
+  unsigned int maxBucket = BucketOf(rect.max);
+  unsigned int x0 = minBucket % columns;
+  unsigned int y0 = minBucket / columns;
+  unsigned int x1 = maxBucket % columns;
+  unsigned int y1 = maxBucket / columns;
+
+  for (unsigned int y = y0;
+       y <= y1;
+       y++)
+  {
+    unsigned int first = bucketStarts[y * columns + x0];
+    unsigned int end   = bucketStarts[y * columns + x1 + 1u];
+
+    if (first == end)
+    {
+      continue;
+    }
+
+    if (!ranges.empty() && (ranges.back().first + ranges.back().count) == first)
+    {
+      ranges.back().count += end - first;
+    }
+    else
+    {
+      ranges.push_back(ItemRange{first, end - first});
+    }
+  }
+}
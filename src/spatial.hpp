@@ -0,0 +1,49 @@
+/*
+ * Copyright (C) 2017, Isaac Woods.
+ * See LICENCE.md
+ */
+
+#pragma once
+
+#include <vector>
+#include <maths.hpp>
+
+/*
+ * A contiguous range of items, in whatever units the user of a grid is counting in.
+ */
+struct ItemRange
+{
+  unsigned int first;
+  unsigned int count;
+};
+
+/*
+ * Buckets items by position into a fixed grid over a rectangle. Buckets are stored row-major, and the items in
+ * each bucket are expected to be stored contiguously in bucket order, so the buckets that overlap a rectangle
+ * make up at most one contiguous range of items per row.
+ */
+struct UniformGrid
+{
+  UniformGrid();
+  UniformGrid(const Rect& bounds, unsigned int numItemsHint, unsigned int itemsPerBucket);
+
+  unsigned int BucketOf(const Vec<2u>& position) const;
+
+  /*
+   * Takes the bucket of each item, and fills `order` with the indices of the items sorted into bucket order.
+   * After this, `bucketStarts` holds the position in that order where each bucket starts.
+   */
+  void Build(const std::vector<unsigned int>& itemBuckets, std::vector<unsigned int>& order);
+
+  /*
+   * Appends the ranges of items (in bucket order) that are in buckets overlapping `rect`. Ranges that touch are
+   * merged, so querying the whole grid produces a single range.
+   */
+  void Query(const Rect& rect, std::vector<ItemRange>& ranges) const;
+
+  Rect                      bounds;
+  unsigned int              columns;
+  unsigned int              rows;
+  Vec<2u>                   bucketSize;
+  std::vector<unsigned int> bucketStarts;   // One per bucket, plus one past the end
+};
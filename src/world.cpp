@@ -7,6 +7,8 @@
 #include <iostream>
 #include <random>
 #include <algorithm>
+#include <map>
+#include <cstddef>
 #include <imgui/imgui.hpp>
 
 bool Triangle::HasVertex(const Vec<2u>& v) const
@@ -93,7 +95,32 @@ World::World(const std::string& name, PointGenerator* pointGenerator, float widt
   ,triangles()
   ,edges()
   ,polygons()
-  ,numPolygonIndices(0u)
+  ,elevations()
+  ,biomeColors()
+  ,pointOrder()
+  ,selectedCell(-1)
+  ,vao(0u)
+  ,vbo(0u)
+  ,ebo(0u)
+  ,cellColors(GL_TEXTURE_BUFFER)
+  ,cellColorTexture(0u)
+  ,layers()
+  ,commands()
+  ,visibleRanges()
+  ,entityGrid()
+  ,gridEntities()
+  ,entityOrder()
+  ,entityMargin(0.0f)
+  ,entityGridDirty(true)
+  ,visibleEntities()
+  ,entityInstances()
+  ,batchedView()
+  ,entityBatchesValid(false)
+  ,mapCache()
+  ,cachedView()
+  ,mapCacheValid(false)
+  ,cacheMap(true)
+  ,renderCells(true)
   ,renderPoints(true)
   ,renderDelaunay(true)
   ,renderCentroids(true)
@@ -101,51 +128,157 @@ World::World(const std::string& name, PointGenerator* pointGenerator, float widt
 {
   points = pointGenerator->Generate();
 
-  glGenVertexArrays(1, &pointsVAO);
-  glBindVertexArray(pointsVAO);
-  glGenBuffers(1, &pointsVBO);
-  glBindBuffer(GL_ARRAY_BUFFER, pointsVBO);
-  glBufferData(GL_ARRAY_BUFFER, points.size() * sizeof(Vec<2u>), &(points[0u]), GL_STATIC_DRAW);
-  glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(Vec<2u>), (void*)0);
-  glEnableVertexAttribArray(0);
-
   DelaunayTriangulate();
   FindPolygons();
+  GenerateElevation();
+  CreateGeometryBuffers();
+}
+
+World::~World()
+{
+  ClearEntities();
+
+  glDeleteBuffers(1, &vbo);
+  glDeleteBuffers(1, &ebo);
+  glDeleteVertexArrays(1, &vao);
+  glDeleteTextures(1, &cellColorTexture);
+}
+
+static uint32_t PackColor(uint8_t r, uint8_t g, uint8_t b)
+{
+  return static_cast<uint32_t>(r) | (static_cast<uint32_t>(g) << 8u) | (static_cast<uint32_t>(b) << 16u) | (0xFFu << 24u);
+}
 
-  std::vector<GLfloat> edgeVertices;
-  for (Edge& edge : edges)
+static uint32_t GetBiomeColor(float elevation)
+{
+  if (elevation < 0.30f)  return PackColor( 28,  74, 140);  // Deep water
+  if (elevation < 0.40f)  return PackColor( 52, 118, 184);  // Shallows
+  if (elevation < 0.45f)  return PackColor(222, 206, 150);  // Beach
+  if (elevation < 0.65f)  return PackColor( 96, 160,  72);  // Grassland
+  if (elevation < 0.80f)  return PackColor( 48, 110,  56);  // Forest
+  if (elevation < 0.92f)  return PackColor(128, 120, 112);  // Mountain
+  return PackColor(240, 240, 240);                          // Snow
+}
+
+/*
+ * Gives each cell an elevation that falls off towards the edges of the map (so we end up with an island), with
+ * some noise on top, and colors it by the biome that elevation puts it in.
+ */
+void World::GenerateElevation()
+{
+  std::random_device randomDevice;
+  std::mt19937 generator(randomDevice());
+  std::uniform_real_distribution<float> noise(-0.15f, 0.15f);
+
+  const Vec<2u> center(width / 2.0f, height / 2.0f);
+  elevations.resize(points.size());
+  biomeColors.resize(points.size());
+
+  for (unsigned int i = 0u;
+       i < points.size();
+       i++)
   {
-    edgeVertices.push_back(edge.a.x());
-    edgeVertices.push_back(edge.a.y());
-    edgeVertices.push_back(edge.b.x());
-    edgeVertices.push_back(edge.b.y());
+    float distance = Length((points[i] - center) / center);
+    elevations[i] = std::min(std::max(1.0f - distance + noise(generator), 0.0f), 1.0f);
+    biomeColors[i] = GetBiomeColor(elevations[i]);
   }
+}
 
-  glGenVertexArrays(1, &triangleEdgeVAO);
-  glBindVertexArray(triangleEdgeVAO);
-  glGenBuffers(1, &triangleEdgeVBO);
-  glBindBuffer(GL_ARRAY_BUFFER, triangleEdgeVBO);
-  glBufferData(GL_ARRAY_BUFFER, edgeVertices.size() * sizeof(GLfloat), &(edgeVertices[0u]), GL_STATIC_DRAW);
-  glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(Vec<2u>), (void*)0);
-  glEnableVertexAttribArray(0);
+/*
+ * How many primitives we aim to have in each bucket of a layer's grid. Smaller buckets let us cull more tightly,
+ * but produce more ranges to draw.
+ */
+static const unsigned int PRIMITIVES_PER_BUCKET = 16u;
 
-  std::vector<Vec<2u>> centroids;
-  for (const Triangle& triangle : triangles)
+void World::CreateGeometryBuffers()
+{
+  const Rect bounds(Vec<2u>(0.0f, 0.0f), Vec<2u>(width, height));
+  std::vector<unsigned int> buckets;
+  std::vector<unsigned int> order;
+
+  auto createGrid = [&](WorldLayer layer, unsigned int numPrimitives, auto getPosition)
+    {
+      layers[layer].grid = UniformGrid(bounds, numPrimitives, PRIMITIVES_PER_BUCKET);
+      buckets.resize(numPrimitives);
+
+      for (unsigned int i = 0u;
+           i < numPrimitives;
+           i++)
+      {
+        buckets[i] = layers[layer].grid.BucketOf(getPosition(i));
+      }
+
+      layers[layer].grid.Build(buckets, order);
+    };
+
+  std::vector<WorldVertex> vertices;
+  vertices.reserve(points.size() + triangles.size());
+
+  // Points, which are also the vertices of the Delaunay triangulation
+  std::vector<GLuint> pointVertices(points.size());
+  createGrid(LAYER_POINTS, points.size(), [this](unsigned int i) { return points[i]; });
+
+  pointOrder = order;
+
+  for (unsigned int i : order)
   {
-    centroids.push_back(triangle.centroid);
+    pointVertices[i] = vertices.size();
+    vertices.push_back(WorldVertex{points[i], i});
   }
 
-  glGenVertexArrays(1, &centroidVAO);
-  glBindVertexArray(centroidVAO);
-  glGenBuffers(1, &centroidVBO);
-  glBindBuffer(GL_ARRAY_BUFFER, centroidVBO);
-  glBufferData(GL_ARRAY_BUFFER, centroids.size() * sizeof(Vec<2u>), &(centroids[0u]), GL_STATIC_DRAW);
-  glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(Vec<2u>), (void*)0);
-  glEnableVertexAttribArray(0);
+  // Centroids, which are also the vertices of the dual mesh
+  const GLuint firstCentroid = vertices.size();
+  std::vector<GLuint> centroidVertices(triangles.size());
+  createGrid(LAYER_CENTROIDS, triangles.size(), [this](unsigned int i) { return triangles[i].centroid; });
+
+  for (unsigned int i : order)
+  {
+    centroidVertices[i] = vertices.size();
+    vertices.push_back(WorldVertex{triangles[i].centroid, 0u});
+  }
+
+  /*
+   * The triangles only store the positions of their vertices, so we need to be able to find the index of the
+   * point each one came from to index into the vertex buffer.
+   */
+  std::map<std::pair<float, float>, GLuint> pointIndices;
+  for (unsigned int i = 0u;
+       i < points.size();
+       i++)
+  {
+    pointIndices[std::make_pair(points[i].x(), points[i].y())] = pointVertices[i];
+  }
+
+  auto pointIndex = [&pointIndices](const Vec<2u>& point)
+    {
+      return pointIndices.at(std::make_pair(point.x(), point.y()));
+    };
+
+  // Delaunay edges, bucketed by their midpoints
+  std::vector<GLuint> indices;
+  float edgeMargin = 0.0f;
+  createGrid(LAYER_DELAUNAY, edges.size(), [this](unsigned int i) { return (edges[i].a + edges[i].b) / 2.0f; });
+
+  for (unsigned int i : order)
+  {
+    indices.push_back(pointIndex(edges[i].a));
+    indices.push_back(pointIndex(edges[i].b));
+    edgeMargin = std::max(edgeMargin, Length(edges[i].b - edges[i].a) / 2.0f);
+  }
 
-  std::vector<GLfloat> polygonVertices;
-  for (const Polygon& polygon : polygons)
+  const unsigned int numEdgeIndices = indices.size();
+
+  // Edges of the dual mesh, bucketed by the point at the center of the polygon they're part of
+  std::vector<std::pair<GLuint, GLuint>> polygonEdges;
+  std::vector<unsigned int> polygonEdgeCells;
+  float polygonMargin = 0.0f;
+
+  for (unsigned int i = 0u;
+       i < polygons.size();
+       i++)
   {
+    const Polygon& polygon = polygons[i];
+
     if (polygon.vertices.size() == 0)
       continue;
 
@@ -153,82 +286,373 @@ World::World(const std::string& name, PointGenerator* pointGenerator, float widt
          pointIt < std::prev(polygon.vertices.end());
          pointIt++)
     {
-      polygonVertices.push_back(pointIt->position.x());
-      polygonVertices.push_back(pointIt->position.y());
-      polygonVertices.push_back(std::next(pointIt)->position.x());
-      polygonVertices.push_back(std::next(pointIt)->position.y());
-      numPolygonIndices += 2u;
+      polygonEdges.push_back(std::make_pair(centroidVertices[pointIt->triangleIndex],
+                                            centroidVertices[std::next(pointIt)->triangleIndex]));
+      polygonEdgeCells.push_back(i);
+    }
+
+    for (const PolygonPoint& vertex : polygon.vertices)
+    {
+      polygonMargin = std::max(polygonMargin, Length(vertex.position - points[i]));
     }
   }
 
-  glGenVertexArrays(1, &polygonVAO);
-  glBindVertexArray(polygonVAO);
-  glGenBuffers(1, &polygonVBO);
-  glBindBuffer(GL_ARRAY_BUFFER, polygonVBO);
-  glBufferData(GL_ARRAY_BUFFER, polygonVertices.size() * sizeof(GLfloat), &(polygonVertices[0u]), GL_STATIC_DRAW);
-  glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(Vec<2u>), (void*)0);
+  createGrid(LAYER_POLYGONS, polygonEdges.size(), [&](unsigned int i) { return points[polygonEdgeCells[i]]; });
+
+  for (unsigned int i : order)
+  {
+    indices.push_back(polygonEdges[i].first);
+    indices.push_back(polygonEdges[i].second);
+  }
+
+  /*
+   * Cells are filled with a fan of triangles around their centers. The center goes last, so that it's the
+   * provoking vertex, and the whole cell picks up its index. Unlike the outlines, the rings are closed.
+   */
+  std::vector<GLuint> cellTriangles;
+  std::vector<unsigned int> cellTriangleCells;
+
+  for (unsigned int i = 0u;
+       i < polygons.size();
+       i++)
+  {
+    const std::vector<PolygonPoint>& ring = polygons[i].vertices;
+
+    if (ring.size() < 3u)
+      continue;
+
+    for (unsigned int j = 0u;
+         j < ring.size();
+         j++)
+    {
+      cellTriangles.push_back(centroidVertices[ring[j].triangleIndex]);
+      cellTriangles.push_back(centroidVertices[ring[(j + 1u) % ring.size()].triangleIndex]);
+      cellTriangles.push_back(pointVertices[i]);
+      cellTriangleCells.push_back(i);
+    }
+  }
+
+  const unsigned int firstCellIndex = indices.size();
+  createGrid(LAYER_CELLS, cellTriangleCells.size(), [&](unsigned int i) { return points[cellTriangleCells[i]]; });
+
+  for (unsigned int i : order)
+  {
+    indices.insert(indices.end(), &cellTriangles[i * 3u], &cellTriangles[i * 3u] + 3u);
+  }
+
+  layers[LAYER_CELLS].primitive               = GL_TRIANGLES;
+  layers[LAYER_CELLS].indexed                 = true;
+  layers[LAYER_CELLS].first                   = firstCellIndex;
+  layers[LAYER_CELLS].count                   = indices.size() - firstCellIndex;
+  layers[LAYER_CELLS].verticesPerPrimitive    = 3u;
+  layers[LAYER_CELLS].margin                  = polygonMargin;
+
+  layers[LAYER_POINTS].primitive              = GL_POINTS;
+  layers[LAYER_POINTS].first                  = 0u;
+  layers[LAYER_POINTS].count                  = points.size();
+
+  layers[LAYER_CENTROIDS].primitive           = GL_POINTS;
+  layers[LAYER_CENTROIDS].first               = firstCentroid;
+  layers[LAYER_CENTROIDS].count               = triangles.size();
+
+  layers[LAYER_DELAUNAY].primitive            = GL_LINES;
+  layers[LAYER_DELAUNAY].indexed              = true;
+  layers[LAYER_DELAUNAY].first                = 0u;
+  layers[LAYER_DELAUNAY].count                = numEdgeIndices;
+  layers[LAYER_DELAUNAY].verticesPerPrimitive = 2u;
+  layers[LAYER_DELAUNAY].margin               = edgeMargin;
+
+  layers[LAYER_POLYGONS].primitive            = GL_LINES;
+  layers[LAYER_POLYGONS].indexed              = true;
+  layers[LAYER_POLYGONS].first                = numEdgeIndices;
+  layers[LAYER_POLYGONS].count                = firstCellIndex - numEdgeIndices;
+  layers[LAYER_POLYGONS].verticesPerPrimitive = 2u;
+  layers[LAYER_POLYGONS].margin               = polygonMargin;
+
+  // NOTE(Isaac): the buffers are sized exactly once here and never respecified
+  glGenVertexArrays(1, &vao);
+  glBindVertexArray(vao);
+
+  glGenBuffers(1, &vbo);
+  glBindBuffer(GL_ARRAY_BUFFER, vbo);
+  glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(WorldVertex), vertices.data(), GL_STATIC_DRAW);
+  glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(WorldVertex), (const void*)offsetof(WorldVertex, position));
+  glVertexAttribIPointer(1, 1, GL_UNSIGNED_INT, sizeof(WorldVertex), (const void*)offsetof(WorldVertex, cell));
   glEnableVertexAttribArray(0);
+  glEnableVertexAttribArray(1);
+
+  glGenBuffers(1, &ebo);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+
+  glBindVertexArray(0);
+
+  // The cells' colors are looked up by the fragment shader through a buffer texture
+  cellColors.Create(biomeColors);
+
+  glGenTextures(1, &cellColorTexture);
+  glBindTexture(GL_TEXTURE_BUFFER, cellColorTexture);
+  glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA8, cellColors.handle);
+  glBindTexture(GL_TEXTURE_BUFFER, 0);
 }
 
-World::~World()
+/*
+ * Records a multi-draw of the parts of a layer that could be in view.
+ */
+void World::RecordLayer(Renderer& renderer, WorldLayer layer, const Rect& view, const Vec<4u>& color)
 {
-  for (Entity* entity : entities)
+  const LayerRange& range = layers[layer];
+
+  visibleRanges.clear();
+  range.grid.Query(view.Expand(range.margin), visibleRanges);
+
+  if (visibleRanges.empty())
+  {
+    return;
+  }
+
+  DrawCommand command;
+  command.vao           = vao;
+  command.primitive     = range.primitive;
+  command.indexType     = (range.indexed ? GL_UNSIGNED_INT : GL_NONE);
+  command.firstRange    = commands.ranges.size();
+  command.rangeCount    = visibleRanges.size();
+
+  if (layer == LAYER_CELLS)
+  {
+    command.key           = MakeSortKey(PASS_CELLS, renderer.cellShader->handle, cellColorTexture, vao, 0u);
+    command.shader        = renderer.cellShader;
+    command.texture       = cellColorTexture;
+    command.textureTarget = GL_TEXTURE_BUFFER;
+  }
+  else
+  {
+    command.key           = MakeSortKey(PASS_WORLD, renderer.shader->handle, 0u, vao, static_cast<unsigned int>(layer));
+    command.shader        = renderer.shader;
+    command.colorUniform  = renderer.colorUniform;
+    command.color         = color;
+  }
+
+  commands.commands.push_back(command);
+
+  for (const ItemRange& primitives : visibleRanges)
   {
-    delete entity;
+    commands.ranges.push_back(ItemRange{range.first + primitives.first * range.verticesPerPrimitive,
+                                        primitives.count * range.verticesPerPrimitive});
   }
+}
+
+int World::FindNearestCell(const Vec<2u>& position) const
+{
+  const LayerRange& range = layers[LAYER_CELLS];
+  std::vector<ItemRange> candidates;
+  layers[LAYER_POINTS].grid.Query(Rect(position, position).Expand(range.margin), candidates);
+
+  int nearest = -1;
+  float nearestDistanceSq = range.margin * range.margin;
+
+  for (const ItemRange& candidateRange : candidates)
+  {
+    for (unsigned int i = candidateRange.first;
+         i < candidateRange.first + candidateRange.count;
+         i++)
+    {
+      float distanceSq = LengthSq(points[pointOrder[i]] - position);
+
+      if (distanceSq <= nearestDistanceSq)
+      {
+        nearest = static_cast<int>(pointOrder[i]);
+        nearestDistanceSq = distanceSq;
+      }
+    }
+  }
+
+  return nearest;
+}
+
+void World::SelectCell(int cell)
+{
+  static const uint32_t SELECTED_COLOR = PackColor(255, 220, 0);
+
+  if (selectedCell != -1)
+  {
+    SetCellColor(selectedCell, biomeColors[selectedCell]);
+  }
+
+  selectedCell = cell;
+
+  if (selectedCell != -1)
+  {
+    SetCellColor(selectedCell, SELECTED_COLOR);
+  }
+}
+
+/*
+ * Only the cells that have changed are uploaded, the next time the world is rendered.
+ */
+void World::SetCellColor(unsigned int cell, uint32_t color)
+{
+  cellColors.Set(cell, color);
+}
+
+bool World::HasPendingChanges() const
+{
+  return cellColors.IsDirty() || entityGridDirty;
+}
+
+void World::ClearEntities()
+{
+  entities.Clear();
+  entityGridDirty = true;
+}
+
+void World::MarkEntitiesMoved()
+{
+  entityGridDirty = true;
+}
 
-  glDeleteBuffers(1, &pointsVBO);
-  glDeleteVertexArrays(1, &pointsVAO);
+void World::UpdateEntityGrid()
+{
+  const unsigned int numEntities = entities.Count<LocalToWorld, Renderable>();
+  entityGrid = UniformGrid(Rect(Vec<2u>(0.0f, 0.0f), Vec<2u>(width, height)), numEntities, PRIMITIVES_PER_BUCKET);
+  entityMargin = 0.0f;
+
+  std::vector<unsigned int> buckets;
+  buckets.reserve(numEntities);
+  gridEntities.clear();
+  gridEntities.reserve(numEntities);
+
+  entities.ForEach<const LocalToWorld, const Renderable>(
+    [&](Entity entity, const LocalToWorld& localToWorld, const Renderable& renderable)
+    {
+      // NOTE(Isaac): the translation is the last column, and the (uniform) scale is the length of the others
+      const Mat<4u>& m = localToWorld.matrix;
+      float scale = Length(Vec<3u>(m[0u][0u], m[0u][1u], m[0u][2u]));
+
+      gridEntities.push_back(entity);
+      buckets.push_back(entityGrid.BucketOf(Vec<2u>(m[3u][0u], m[3u][1u])));
+      entityMargin = std::max(entityMargin, renderable.mesh->boundingRadius * scale);
+    });
+
+  entityGrid.Build(buckets, entityOrder);
+  entityGridDirty = false;
 }
 
 void World::Render(Renderer& renderer)
 {
-  SetUniform(renderer.shader, "color", Vec<4u>(1.0, 0.0, 1.0, 1.0));
+  const Vec<4u> MAGENTA(1.0f, 0.0f, 1.0f, 1.0f);
+  const Vec<4u> WHITE(1.0f, 1.0f, 1.0f, 1.0f);
+  const Rect view = renderer.camera.GetViewBounds();
 
-  if (renderPoints)
+  /*
+   * The map doesn't change unless it's edited or the camera moves, so we only redraw it into the cache when
+   * one of those things happens. Otherwise, drawing it is just a copy of the cache.
+   */
+  if (cellColors.IsDirty() || !(view == cachedView))
   {
-    glBindVertexArray(pointsVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, pointsVBO);
-    glDrawArrays(GL_POINTS, 0, points.size());
+    mapCacheValid = false;
   }
 
-  if (renderDelaunay)
+  if (mapCache.width != renderer.width || mapCache.height != renderer.height)
   {
-    glBindVertexArray(triangleEdgeVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, triangleEdgeVBO);
-    glDrawArrays(GL_LINES, 0, edges.size() * 4u);
+    mapCache.Resize(renderer.width, renderer.height);
+    mapCacheValid = false;
   }
 
-  SetUniform(renderer.shader, "color", Vec<4u>(1.0, 1.0, 1.0, 1.0));
+  commands.Clear();
+  cellColors.Upload(renderer.frameStats);
 
-  if (renderCentroids)
+  if (!cacheMap || !mapCacheValid)
   {
-    glBindVertexArray(centroidVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, centroidVBO);
-    glDrawArrays(GL_POINTS, 0, triangles.size());
+    if (renderCells)      RecordLayer(renderer, LAYER_CELLS,     view, WHITE);
+    if (renderPoints)     RecordLayer(renderer, LAYER_POINTS,    view, MAGENTA);
+    if (renderDelaunay)   RecordLayer(renderer, LAYER_DELAUNAY,  view, MAGENTA);
+    if (renderCentroids)  RecordLayer(renderer, LAYER_CENTROIDS, view, WHITE);
+    if (renderPolygons)   RecordLayer(renderer, LAYER_POLYGONS,  view, WHITE);
   }
 
-  if (renderPolygons)
+  if (cacheMap)
   {
-    glBindVertexArray(polygonVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, polygonVBO);
-    glDrawArrays(GL_LINES, 0, numPolygonIndices);
+    if (!mapCacheValid)
+    {
+      renderer.RenderToTarget(mapCache, commands);
+      commands.Clear();
+      mapCacheValid = true;
+      cachedView = view;
+    }
+
+    renderer.RecordFullscreenTexture(commands, PASS_CELLS, mapCache.colorTexture);
   }
 
-  for (Entity* entity : entities)
+  /*
+   * Like the map, the entities' batches are only worked out again when something moves, or the camera does.
+   * Otherwise, drawing them is just the last frame's draws again.
+   */
+  if (entityGridDirty)
+  {
+    UpdateEntityGrid();
+    entityBatchesValid = false;
+  }
+
+  if (renderer.UpdateEntityTransforms(entityInstances, entities))
   {
-    if (entity->GetComponent<Renderable>())
+    entityBatchesValid = false;
+  }
+
+  if (!entityBatchesValid || !(view == batchedView) || entityInstances.batched != renderer.batchEntities)
+  {
+    visibleRanges.clear();
+    visibleEntities.clear();
+    entityGrid.Query(view.Expand(entityMargin), visibleRanges);
+
+    for (const ItemRange& range : visibleRanges)
     {
-      renderer.RenderEntity(entity);
+      for (unsigned int i = range.first;
+           i < range.first + range.count;
+           i++)
+      {
+        visibleEntities.push_back(gridEntities[entityOrder[i]]);
+      }
     }
+
+    renderer.BatchEntities(entityInstances, entities, visibleEntities);
+    batchedView = view;
+    entityBatchesValid = true;
   }
 
-  ImGui::SetNextWindowSize(ImVec2(210, 150));
+  renderer.RecordEntities(commands, entityInstances);
+  renderer.Submit(commands);
+
+  ImGui::SetNextWindowSize(ImVec2(210, 220));
   ImGui::Begin("Generation", nullptr, ImGuiWindowFlags_NoResize);
-  ImGui::Checkbox("Points", &renderPoints);
-  ImGui::Checkbox("Delaunay triangulation", &renderDelaunay);
-  ImGui::Checkbox("Centroids", &renderCentroids);
-  ImGui::Checkbox("Barycentric dual mesh", &renderPolygons);
+  bool layersChanged = false;
+  layersChanged |= ImGui::Checkbox("Filled cells", &renderCells);
+  layersChanged |= ImGui::Checkbox("Points", &renderPoints);
+  layersChanged |= ImGui::Checkbox("Delaunay triangulation", &renderDelaunay);
+  layersChanged |= ImGui::Checkbox("Centroids", &renderCentroids);
+  layersChanged |= ImGui::Checkbox("Barycentric dual mesh", &renderPolygons);
+  layersChanged |= ImGui::Checkbox("Cache map", &cacheMap);
+
+  if (layersChanged)
+  {
+    mapCacheValid = false;
+  }
+
+  if (ImGui::Button("Recolor 100 cells"))
+  {
+    std::mt19937 generator(std::random_device{}());
+    std::uniform_int_distribution<unsigned int> cellDistribution(0u, points.size() - 1u);
+    std::uniform_int_distribution<unsigned int> channelDistribution(0u, 255u);
+
+    for (unsigned int i = 0u;
+         i < 100u;
+         i++)
+    {
+      SetCellColor(cellDistribution(generator), PackColor(channelDistribution(generator),
+                                                          channelDistribution(generator),
+                                                          channelDistribution(generator)));
+    }
+  }
   ImGui::End();
 }
 
@@ -355,12 +779,14 @@ void World::FindPolygons()
   {
     Polygon polygon;
 
-    for (const Triangle& triangle : triangles)
+    for (unsigned int i = 0u;
+         i < triangles.size();
+         i++)
     {
-//      printf("Triangle has vertex: %s\n", (triangle.HasVertex(point) ? "true" : "false"));
-      if (triangle.HasVertex(point))
+//      printf("Triangle has vertex: %s\n", (triangles[i].HasVertex(point) ? "true" : "false"));
+      if (triangles[i].HasVertex(point))
       {
-        polygon.vertices.push_back(PolygonPoint(triangle.centroid));
+        polygon.vertices.push_back(PolygonPoint(triangles[i].centroid, i));
       }
     }
 
@@ -10,6 +10,7 @@
 #include <maths.hpp>
 #include <entity.hpp>
 #include <rendering.hpp>
+#include <spatial.hpp>
 
 struct Edge
 {
@@ -65,11 +66,13 @@ struct DelaunayPoint
 
 struct PolygonPoint
 {
-  PolygonPoint(const Vec<2u>& position)
+  PolygonPoint(const Vec<2u>& position, unsigned int triangleIndex)
     :position(position)
+    ,triangleIndex(triangleIndex)
   { }
 
-  Vec<2u> position;
+  Vec<2u>       position;
+  unsigned int  triangleIndex;  // Index of the triangle this is the centroid of
 };
 
 struct Polygon
@@ -124,38 +127,122 @@ struct JitteredPointGenerator : PointGenerator
   unsigned int numRows;
 };
 
-struct World
+/*
+ * All of the world's geometry is packed into a single vertex buffer (the Delaunay points, then the centroids)
+ * and a single index buffer (the triangle edges, then the dual mesh's edges). Each layer is a range of one of them.
+ */
+enum WorldLayer
 {
-  World(const std::string& name, PointGenerator* pointGenerator, float width, float height);
-  ~World();
+  LAYER_CELLS,
+  LAYER_POINTS,
+  LAYER_DELAUNAY,
+  LAYER_CENTROIDS,
+  LAYER_POLYGONS,
+  NUM_LAYERS
+};
 
-  void Render(Renderer& renderer);
+/*
+ * The index of the cell a vertex belongs to is only meaningful for the points at the centers of cells, which are
+ * the provoking vertices of the cells' triangles.
+ */
+struct WorldVertex
+{
+  Vec<2u> position;
+  GLuint  cell;
+};
 
-  std::string           name;
-  float                 width;
-  float                 height;
-  std::vector<Entity*>  entities;
-private:
-  std::vector<Vec<2u>>  points;
+/*
+ * The primitives of each layer are sorted by which bucket of the layer's grid they fall into, so the part of a
+ * layer that's in view can be drawn as a handful of ranges.
+ */
+struct LayerRange
+{
+  LayerRange()
+    :primitive(GL_POINTS)
+    ,indexed(false)
+    ,first(0u)
+    ,count(0u)
+    ,verticesPerPrimitive(1u)
+    ,margin(0.0f)
+    ,grid()
+  { }
 
-  std::vector<Triangle> triangles;
-  std::vector<Edge>     edges;
+  GLenum        primitive;
+  bool          indexed;
+  unsigned int  first;    // NOTE(Isaac): first vertex for array layers, first index for indexed ones
+  unsigned int  count;
+  unsigned int  verticesPerPrimitive;
+  float         margin;   // How far a primitive can reach outside of the bucket it's in
+  UniformGrid   grid;
+};
 
-  std::vector<Polygon>  polygons;
+struct World
+{
+  World(const std::string& name, PointGenerator* pointGenerator, float width, float height);
+  ~World();
 
-  GLuint                pointsVAO;
-  GLuint                pointsVBO;
+  void Render(Renderer& renderer);
 
-  GLuint                triangleEdgeVAO;
-  GLuint                triangleEdgeVBO;
+  /*
+   * Returns the index of the cell whose center is closest to `position`, or -1 if there isn't one nearby.
+   */
+  int FindNearestCell(const Vec<2u>& position) const;
+  void SelectCell(int cell);
+  void SetCellColor(unsigned int cell, uint32_t color);
 
-  GLuint                centroidVAO;
-  GLuint                centroidVBO;
+  /*
+   * Whether the world has changed in a way that hasn't been drawn yet.
+   */
+  bool HasPendingChanges() const;
 
-  GLuint                polygonVAO;
-  GLuint                polygonVBO;
-  unsigned int          numPolygonIndices;
+  /*
+   * Entities are bucketed into a grid (by their `LocalToWorld`s) so we only have to look at the ones near the
+   * view. Anything that changes `entities`, or moves an entity, should call `MarkEntitiesMoved`.
+   */
+  void ClearEntities();
+  void MarkEntitiesMoved();
 
+  std::string               name;
+  float                     width;
+  float                     height;
+  EntityManager             entities;
+private:
+  std::vector<Vec<2u>>      points;
+
+  std::vector<Triangle>     triangles;
+  std::vector<Edge>         edges;
+
+  std::vector<Polygon>      polygons;
+  std::vector<float>        elevations;   // One per cell
+  std::vector<uint32_t>     biomeColors;  // One per cell, as packed RGBA8
+  std::vector<unsigned int> pointOrder;   // Indices of the points, in the order of the points layer's grid
+  int                       selectedCell;
+
+  GLuint                    vao;
+  GLuint                    vbo;
+  GLuint                    ebo;
+  StreamedBuffer<uint32_t>  cellColors;   // One per cell, as packed RGBA8
+  GLuint                    cellColorTexture;
+  LayerRange                layers[NUM_LAYERS];
+  CommandList               commands;
+  std::vector<ItemRange>    visibleRanges;
+
+  UniformGrid               entityGrid;
+  std::vector<Entity>       gridEntities;   // The entities that can be drawn, in the order they were bucketed
+  std::vector<unsigned int> entityOrder;    // Indices into `gridEntities`, in bucket order
+  float                     entityMargin;
+  bool                      entityGridDirty;
+  std::vector<Entity>       visibleEntities;
+  EntityInstances           entityInstances;
+  Rect                      batchedView;    // NOTE(Isaac): the view `entityInstances` were last batched for
+  bool                      entityBatchesValid;
+
+  RenderTarget              mapCache;     // Holds all of the map's layers, as they were last drawn
+  Rect                      cachedView;
+  bool                      mapCacheValid;
+  bool                      cacheMap;
+
+  bool renderCells;
   bool renderPoints;
   bool renderDelaunay;
   bool renderCentroids;
@@ -163,4 +250,8 @@ private:
 
   void DelaunayTriangulate();
   void FindPolygons();
+  void GenerateElevation();
+  void CreateGeometryBuffers();
+  void RecordLayer(Renderer& renderer, WorldLayer layer, const Rect& view, const Vec<4u>& color);
+  void UpdateEntityGrid();
 };
@@ -0,0 +1,1114 @@
+/*
+ * Copyright (C) 2017, Isaac Woods.
+ * See LICENCE.md
+ */
+
+/*
+ * Turns assets from the formats they're authored in into the formats the game loads at runtime, so the game
+ * doesn't have to do any importing or processing itself.
+ *
+ *    cooker mesh <input.dae|input.blend> <output.mesh> [--right-handed] [--float]
+ *    cooker texture <input.png> <output.tex> [--linear] [--compress]
+ *    cooker pack <output.pack> <files...> [--compress]
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cassert>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+#include <asset.hpp>
+#include <compression.hpp>
+#include <maths.hpp>
+#include <optimise.hpp>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.hpp>
+
+// --- Meshes ---
+/*
+ * Imports every mesh in the file into one `MeshData`, with a submesh for each. Node transforms are baked into
+ * the vertices, so a model made of several parts comes out assembled.
+ */
+static MeshData ImportScene(const std::string& path, bool convertToRightHanded)
+{
+  Assimp::Importer importer;
+
+  const aiScene* scene = importer.ReadFile(path,  aiProcess_GenSmoothNormals      |
+                                                  aiProcess_FlipUVs               |
+                                                  aiProcess_CalcTangentSpace      |
+                                                  aiProcess_Triangulate           |
+                                                  aiProcess_JoinIdenticalVertices |
+                                                  aiProcess_PreTransformVertices  |
+                                                  aiProcess_SortByPType);
+
+  if (!scene)
+  {
+    std::cerr << "Failed to load scene from path: " << path << " (" << importer.GetErrorString() << ")" << std::endl;
+    exit(1);
+  }
+
+  /*
+   * Count everything up first, so we can allocate the whole thing at once. Meshes made of lines or points
+   * (which `SortByPType` has split out for us) are skipped.
+   */
+  unsigned int numVertices = 0u;
+  unsigned int numIndices = 0u;
+
+  for (unsigned int i = 0u;
+       i < scene->mNumMeshes;
+       i++)
+  {
+    const aiMesh* mesh = scene->mMeshes[i];
+
+    if (mesh->mPrimitiveTypes == aiPrimitiveType_TRIANGLE)
+    {
+      numVertices += mesh->mNumVertices;
+      numIndices += mesh->mNumFaces * 3u;   // NOTE(Isaac): we know this because the mesh has been triangulated
+    }
+  }
+
+  if (numVertices == 0u || numIndices == 0u)
+  {
+    std::cerr << "Scene has no triangles to cook: " << path << std::endl;
+    exit(1);
+  }
+
+  MeshData meshData(numVertices, numIndices);
+  unsigned int baseVertex = 0u;
+  unsigned int baseIndex = 0u;
+
+  for (unsigned int m = 0u;
+       m < scene->mNumMeshes;
+       m++)
+  {
+    const aiMesh* mesh = scene->mMeshes[m];
+
+    if (mesh->mPrimitiveTypes != aiPrimitiveType_TRIANGLE)
+    {
+      continue;
+    }
+
+    assert(mesh->HasNormals());
+    assert(mesh->HasTangentsAndBitangents());
+    assert(mesh->HasTextureCoords(0u));
+
+    for (unsigned int i = 0u;
+         i < mesh->mNumVertices;
+         i++)
+    {
+      Vec<3u> normal(mesh->mNormals[i].x, mesh->mNormals[i].y, mesh->mNormals[i].z);
+      Vec<3u> tangent(mesh->mTangents[i].x, mesh->mTangents[i].y, mesh->mTangents[i].z);
+      Vec<3u> bitangent(mesh->mBitangents[i].x, mesh->mBitangents[i].y, mesh->mBitangents[i].z);
+
+      // We only keep the handedness of the bitangent, because the rest can be worked out from the other two
+      float handedness = (Dot(Cross(normal, tangent), bitangent) < 0.0f) ? -1.0f : 1.0f;
+
+      meshData.vertices[baseVertex + i] = Vertex(Vec<3u>(mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z),
+                                                 Vec<2u>(mesh->mTextureCoords[0u][i].x, mesh->mTextureCoords[0u][i].y),
+                                                 normal,
+                                                 Vec<4u>(tangent, handedness));
+    }
+
+    // The indices are offset, so they index into the shared vertex buffer
+    for (unsigned int i = 0u;
+         i < mesh->mNumFaces;
+         i++)
+    {
+      const aiFace& face = mesh->mFaces[i];
+      assert(face.mNumIndices == 3u);
+
+      meshData.indices[baseIndex+i*3u+0u] = baseVertex + face.mIndices[0u];
+      meshData.indices[baseIndex+i*3u+1u] = baseVertex + face.mIndices[1u];
+      meshData.indices[baseIndex+i*3u+2u] = baseVertex + face.mIndices[2u];
+    }
+
+    meshData.submeshes.push_back(Submesh{baseIndex, mesh->mNumFaces * 3u, mesh->mMaterialIndex});
+    baseVertex += mesh->mNumVertices;
+    baseIndex += mesh->mNumFaces * 3u;
+  }
+
+  /*
+   * Some tools use a left-handed coordinate system (i.e. Blender), and we can't read this using Assimp (even
+   * tho it's in the Collada file), so we can flip it into RH here.
+   */
+  if (convertToRightHanded)
+  {
+    static const Mat<4u> TO_RH_MATRIX = Rotation<4u>(Quaternion(Vec<3u>(1.0f, 0.0f, 0.0f), RADIANS(-90.0f)));
+
+    for (unsigned int i = 0u;
+         i < meshData.numVertices;
+         i++)
+    {
+      Vertex& vertex = meshData.vertices[i];
+      Vec<4u> transformedPos = TO_RH_MATRIX * Vec<4u>(vertex.position, 0.0f);
+      Vec<4u> transformedNormal = TO_RH_MATRIX * Vec<4u>(vertex.normal, 0.0f);
+      Vec<4u> transformedTangent = TO_RH_MATRIX * Vec<4u>(vertex.tangent[0u], vertex.tangent[1u], vertex.tangent[2u], 0.0f);
+
+      // NOTE(Isaac): rotating doesn't change the handedness, so we can leave `tangent.w` alone
+      vertex.position = Vec<3u>(transformedPos[0u], transformedPos[1u], transformedPos[2u]);
+      vertex.normal = Vec<3u>(transformedNormal[0u], transformedNormal[1u], transformedNormal[2u]);
+      vertex.tangent = Vec<4u>(transformedTangent[0u], transformedTangent[1u], transformedTangent[2u], vertex.tangent[3u]);
+    }
+  }
+
+  return meshData;
+}
+
+// --- Vertex packing ---
+static uint16_t FloatToHalf(float f)
+{
+  uint32_t bits;
+  memcpy(&bits, &f, sizeof(float));
+
+  uint32_t sign = (bits >> 16u) & 0x8000u;
+  int32_t exponent = static_cast<int32_t>((bits >> 23u) & 0xFFu) - 127 + 15;
+  uint32_t mantissa = bits & 0x7FFFFFu;
+
+  if (exponent <= 0)
+  {
+    // NOTE(Isaac): too small for a normal half, so flush it to zero (texture coordinates don't need denormals)
+    return static_cast<uint16_t>(sign);
+  }
+
+  if (exponent >= 31)
+  {
+    return static_cast<uint16_t>(sign | 0x7C00u);
+  }
+
+  // Round to nearest, which can carry into the exponent (which is what we want)
+  uint32_t half = sign | (static_cast<uint32_t>(exponent) << 10u) | (mantissa >> 13u);
+  return static_cast<uint16_t>(half + ((mantissa >> 12u) & 1u));
+}
+
+static int16_t PackSnorm16(float f)
+{
+  return static_cast<int16_t>(roundf(std::max(-1.0f, std::min(1.0f, f)) * 32767.0f));
+}
+
+static uint16_t PackUnorm16(float f)
+{
+  return static_cast<uint16_t>(roundf(std::max(0.0f, std::min(1.0f, f)) * 65535.0f));
+}
+
+/*
+ * Maps a unit vector onto an octahedron, then unfolds the octahedron into a square, so it can be stored in two
+ * components without wasting much precision.
+ */
+static void PackOctahedral(const Vec<3u>& v, int16_t* out)
+{
+  float sum = fabsf(v.x()) + fabsf(v.y()) + fabsf(v.z());
+  float x = v.x() / sum;
+  float y = v.y() / sum;
+
+  if (v.z() < 0.0f)
+  {
+    float foldedX = (1.0f - fabsf(y)) * ((x >= 0.0f) ? 1.0f : -1.0f);
+    float foldedY = (1.0f - fabsf(x)) * ((y >= 0.0f) ? 1.0f : -1.0f);
+    x = foldedX;
+    y = foldedY;
+  }
+
+  out[0u] = PackSnorm16(x);
+  out[1u] = PackSnorm16(y);
+}
+
+struct PackedVertex
+{
+  uint16_t  position[4u];
+  uint16_t  texCoord[2u];
+  int16_t   normal[2u];
+  int16_t   tangent[2u];
+};
+
+/*
+ * Packs the vertices into `format`, and fills in the header's dequantisation transform to match.
+ */
+static std::vector<uint8_t> PackVertices(const MeshData& meshData, VertexFormatType format, CookedMeshHeader& header)
+{
+  if (format == VERTEX_FORMAT_FLOAT)
+  {
+    for (unsigned int i = 0u;
+         i < 3u;
+         i++)
+    {
+      header.dequantisationScale[i] = 1.0f;
+      header.dequantisationOffset[i] = 0.0f;
+    }
+
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(meshData.vertices);
+    return std::vector<uint8_t>(bytes, bytes + meshData.numVertices * sizeof(Vertex));
+  }
+
+  static_assert(sizeof(PackedVertex) == 20u, "PackedVertex doesn't match VERTEX_FORMAT_PACKED");
+
+  // Positions are quantised relative to the mesh's bounding box
+  Vec<3u> min = meshData.vertices[0u].position;
+  Vec<3u> max = meshData.vertices[0u].position;
+
+  for (unsigned int i = 1u;
+       i < meshData.numVertices;
+       i++)
+  {
+    for (unsigned int j = 0u;
+         j < 3u;
+         j++)
+    {
+      min[j] = std::min(min[j], meshData.vertices[i].position[j]);
+      max[j] = std::max(max[j], meshData.vertices[i].position[j]);
+    }
+  }
+
+  Vec<3u> extent;
+
+  for (unsigned int i = 0u;
+       i < 3u;
+       i++)
+  {
+    // NOTE(Isaac): flat meshes have no extent along one axis, which we can't divide by
+    extent[i] = std::max(max[i] - min[i], 1e-6f);
+    header.dequantisationScale[i] = extent[i];
+    header.dequantisationOffset[i] = min[i];
+  }
+
+  std::vector<uint8_t> packed(meshData.numVertices * sizeof(PackedVertex));
+  PackedVertex* out = reinterpret_cast<PackedVertex*>(packed.data());
+
+  for (unsigned int i = 0u;
+       i < meshData.numVertices;
+       i++)
+  {
+    const Vertex& vertex = meshData.vertices[i];
+
+    for (unsigned int j = 0u;
+         j < 3u;
+         j++)
+    {
+      out[i].position[j] = PackUnorm16((vertex.position[j] - min[j]) / extent[j]);
+    }
+
+    out[i].position[3u] = (vertex.tangent[3u] < 0.0f) ? 0u : 65535u;
+    out[i].texCoord[0u] = FloatToHalf(vertex.texCoord[0u]);
+    out[i].texCoord[1u] = FloatToHalf(vertex.texCoord[1u]);
+
+    /*
+     * The entity shader applies the dequantisation's scale to the normals and tangents too, just like the
+     * positions. We undo it here, so they come out pointing the right way.
+     */
+    Vec<3u> normal(vertex.normal[0u] / extent[0u], vertex.normal[1u] / extent[1u], vertex.normal[2u] / extent[2u]);
+    Vec<3u> tangent(vertex.tangent[0u] / extent[0u], vertex.tangent[1u] / extent[1u], vertex.tangent[2u] / extent[2u]);
+    PackOctahedral(Normalise(normal), out[i].normal);
+    PackOctahedral(Normalise(tangent), out[i].tangent);
+  }
+
+  return packed;
+}
+
+static void WriteCookedMesh(const MeshData& meshData, VertexFormatType format, const char* path)
+{
+  CookedMeshHeader header;
+  header.magic          = COOKED_MESH_MAGIC;
+  header.version        = COOKED_MESH_VERSION;
+  header.vertexFormat   = format;
+  header.vertexStride   = GetVertexFormat(format).stride;
+  header.indexSize      = (meshData.numVertices <= 0xFFFFu) ? sizeof(uint16_t) : sizeof(uint32_t);
+  header.numVertices    = meshData.numVertices;
+  header.numIndices     = meshData.numIndices;
+  header.numSubmeshes   = static_cast<uint32_t>(meshData.submeshes.size());
+  header.vertexOffset   = sizeof(CookedMeshHeader);
+  header.indexOffset    = header.vertexOffset + meshData.numVertices * header.vertexStride;
+  // NOTE(Isaac): 16-bit indices can leave us misaligned, so the submeshes are padded to a multiple of 4 bytes
+  header.submeshOffset  = (header.indexOffset + meshData.numIndices * header.indexSize + 3u) & ~3u;
+  header.boundingRadius = 0.0f;
+
+  for (unsigned int i = 0u;
+       i < meshData.numVertices;
+       i++)
+  {
+    header.boundingRadius = std::max(header.boundingRadius, Length(meshData.vertices[i].position));
+  }
+
+  std::vector<uint8_t> vertices = PackVertices(meshData, format, header);
+
+  FILE* file = fopen(path, "wb");
+
+  if (!file)
+  {
+    fprintf(stderr, "Failed to open output file: %s\n", path);
+    exit(1);
+  }
+
+  fwrite(&header, sizeof(CookedMeshHeader), 1, file);
+  fwrite(vertices.data(), 1, vertices.size(), file);
+
+  if (header.indexSize == sizeof(uint16_t))
+  {
+    std::vector<uint16_t> indices(meshData.indices, meshData.indices + meshData.numIndices);
+    fwrite(indices.data(), sizeof(uint16_t), indices.size(), file);
+  }
+  else
+  {
+    fwrite(meshData.indices, sizeof(uint32_t), meshData.numIndices, file);
+  }
+
+  static const uint8_t PADDING[4u] = {};
+  fwrite(PADDING, 1, header.submeshOffset - (header.indexOffset + meshData.numIndices * header.indexSize), file);
+  fwrite(meshData.submeshes.data(), sizeof(Submesh), meshData.submeshes.size(), file);
+
+  if (ferror(file))
+  {
+    fprintf(stderr, "Failed to write cooked mesh: %s\n", path);
+    fclose(file);
+    exit(1);
+  }
+
+  fclose(file);
+}
+
+static int CookMesh(int argc, char** argv)
+{
+  if (argc < 2)
+  {
+    fprintf(stderr, "Usage: cooker mesh <input> <output> [--right-handed] [--float]\n");
+    return 1;
+  }
+
+  bool convertToRightHanded = false;
+  VertexFormatType format = VERTEX_FORMAT_PACKED;
+
+  for (int i = 2;
+       i < argc;
+       i++)
+  {
+    if (strcmp(argv[i], "--right-handed") == 0)
+    {
+      convertToRightHanded = true;
+    }
+    else if (strcmp(argv[i], "--float") == 0)
+    {
+      format = VERTEX_FORMAT_FLOAT;
+    }
+    else
+    {
+      fprintf(stderr, "Unknown option: %s\n", argv[i]);
+      return 1;
+    }
+  }
+
+  auto startTime = std::chrono::high_resolution_clock::now();
+  MeshData meshData = ImportScene(argv[0], convertToRightHanded);
+  float importTime = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() -
+                                                              startTime).count();
+
+  /*
+   * NOTE(Isaac): the order matters here - the overdraw pass works on the clusters the cache pass leaves behind,
+   * and the fetch pass only renames vertices, so it can't undo either of them. Triangles are only reordered
+   * within their submesh, so the submeshes' ranges stay the same.
+   */
+  float originalACMR = CalculateACMR(meshData.indices, meshData.numIndices, meshData.numVertices);
+
+  for (const Submesh& submesh : meshData.submeshes)
+  {
+    unsigned int* indices = meshData.indices + submesh.firstIndex;
+    OptimiseVertexCache(indices, submesh.numIndices, meshData.numVertices);
+    OptimiseOverdraw(indices, submesh.numIndices, meshData.vertices, meshData.numVertices, 1.05f);
+  }
+
+  meshData.numVertices = OptimiseVertexFetch(meshData.vertices, meshData.numVertices, meshData.indices,
+                                             meshData.numIndices);
+  float optimisedACMR = CalculateACMR(meshData.indices, meshData.numIndices, meshData.numVertices);
+
+  WriteCookedMesh(meshData, format, argv[1]);
+  printf("Cooked %s -> %s (%u vertices, %u indices, %u submeshes, imported in %.2fms)\n", argv[0], argv[1],
+         meshData.numVertices, meshData.numIndices, static_cast<unsigned int>(meshData.submeshes.size()), importTime);
+  printf("    Vertex data: %u bytes (%u as floats)\n", meshData.numVertices * GetVertexFormat(format).stride,
+         meshData.numVertices * static_cast<unsigned int>(sizeof(Vertex)));
+  printf("    ACMR (%u-entry FIFO): %.3f -> %.3f\n", DEFAULT_VERTEX_CACHE_SIZE, originalACMR, optimisedACMR);
+  return 0;
+}
+
+// --- Textures ---
+/*
+ * Levels are kept as floats while they're being filtered, so precision isn't lost between levels. For sRGB
+ * textures, the colours are in linear space, so averaging them doesn't darken the smaller levels.
+ */
+struct TextureLevel
+{
+  unsigned int        width;
+  unsigned int        height;
+  std::vector<float>  texels;   // NOTE(Isaac): RGBA
+};
+
+static float SRGBToLinear(float c)
+{
+  return (c <= 0.04045f) ? (c / 12.92f) : powf((c + 0.055f) / 1.055f, 2.4f);
+}
+
+static float LinearToSRGB(float c)
+{
+  return (c <= 0.0031308f) ? (c * 12.92f) : (1.055f * powf(c, 1.0f / 2.4f) - 0.055f);
+}
+
+/*
+ * Halves the level in each dimension (down to 1) with a box filter. Odd sizes drop their last row or column,
+ * which is what `glGenerateMipmap` usually does too.
+ */
+static TextureLevel Downsample(const TextureLevel& level)
+{
+  TextureLevel result;
+  result.width = std::max(level.width / 2u, 1u);
+  result.height = std::max(level.height / 2u, 1u);
+  result.texels.resize(result.width * result.height * 4u);
+
+  for (unsigned int y = 0u;
+       y < result.height;
+       y++)
+  {
+    for (unsigned int x = 0u;
+         x < result.width;
+         x++)
+    {
+      float sum[4u] = {};
+
+      for (unsigned int i = 0u;
+           i < 4u;
+           i++)
+      {
+        unsigned int sourceX = std::min(x * 2u + (i % 2u), level.width - 1u);
+        unsigned int sourceY = std::min(y * 2u + (i / 2u), level.height - 1u);
+        const float* texel = &(level.texels[(sourceY * level.width + sourceX) * 4u]);
+
+        for (unsigned int c = 0u;
+             c < 4u;
+             c++)
+        {
+          sum[c] += texel[c];
+        }
+      }
+
+      for (unsigned int c = 0u;
+           c < 4u;
+           c++)
+      {
+        result.texels[(y * result.width + x) * 4u + c] = sum[c] * 0.25f;
+      }
+    }
+  }
+
+  return result;
+}
+
+static std::vector<uint8_t> QuantiseLevel(const TextureLevel& level, bool isSRGB)
+{
+  std::vector<uint8_t> result(level.texels.size());
+
+  for (unsigned int i = 0u;
+       i < level.texels.size();
+       i++)
+  {
+    // NOTE(Isaac): alpha is never sRGB-encoded
+    float value = (isSRGB && (i % 4u) != 3u) ? LinearToSRGB(level.texels[i]) : level.texels[i];
+    result[i] = static_cast<uint8_t>(roundf(std::max(0.0f, std::min(1.0f, value)) * 255.0f));
+  }
+
+  return result;
+}
+
+// --- Block compression ---
+static uint16_t PackRGB565(const uint8_t* color)
+{
+  return static_cast<uint16_t>(((color[0u] >> 3u) << 11u) | ((color[1u] >> 2u) << 5u) | (color[2u] >> 3u));
+}
+
+static void UnpackRGB565(uint16_t packed, int* color)
+{
+  int r = (packed >> 11u) & 0x1F;
+  int g = (packed >> 5u) & 0x3F;
+  int b = packed & 0x1F;
+
+  // NOTE(Isaac): the top bits are repeated into the bottom ones, which is how the GPU expands them too
+  color[0u] = (r << 3) | (r >> 2);
+  color[1u] = (g << 2) | (g >> 4);
+  color[2u] = (b << 3) | (b >> 2);
+}
+
+/*
+ * Encodes the colours of a 4x4 block of RGBA texels into 8 bytes of BC1. The endpoints are the corners of the
+ * block's bounding box, pulled in slightly so they sit on colours that are actually in the block. This is a
+ * lot worse than a proper encoder, but it's fast and good enough for the textures we have.
+ */
+static void EncodeColorBlock(const uint8_t* block, uint8_t* out)
+{
+  uint8_t min[3u] = { 255u, 255u, 255u };
+  uint8_t max[3u] = { 0u, 0u, 0u };
+
+  for (unsigned int i = 0u;
+       i < 16u;
+       i++)
+  {
+    for (unsigned int c = 0u;
+         c < 3u;
+         c++)
+    {
+      min[c] = std::min(min[c], block[i * 4u + c]);
+      max[c] = std::max(max[c], block[i * 4u + c]);
+    }
+  }
+
+  for (unsigned int c = 0u;
+       c < 3u;
+       c++)
+  {
+    uint8_t inset = (max[c] - min[c]) / 16u;
+    min[c] += inset;
+    max[c] -= inset;
+  }
+
+  uint16_t color0 = PackRGB565(max);
+  uint16_t color1 = PackRGB565(min);
+  uint32_t indices = 0u;
+
+  // NOTE(Isaac): BC1 only uses four colours if the first endpoint is bigger (otherwise one is transparent)
+  if (color0 < color1)
+  {
+    std::swap(color0, color1);
+  }
+
+  if (color0 != color1)
+  {
+    int palette[4u][3u];
+    UnpackRGB565(color0, palette[0u]);
+    UnpackRGB565(color1, palette[1u]);
+
+    for (unsigned int c = 0u;
+         c < 3u;
+         c++)
+    {
+      palette[2u][c] = (2 * palette[0u][c] + palette[1u][c]) / 3;
+      palette[3u][c] = (palette[0u][c] + 2 * palette[1u][c]) / 3;
+    }
+
+    for (unsigned int i = 0u;
+         i < 16u;
+         i++)
+    {
+      unsigned int best = 0u;
+      int bestDistance = INT32_MAX;
+
+      for (unsigned int j = 0u;
+           j < 4u;
+           j++)
+      {
+        int distance = 0;
+
+        for (unsigned int c = 0u;
+             c < 3u;
+             c++)
+        {
+          int difference = static_cast<int>(block[i * 4u + c]) - palette[j][c];
+          distance += difference * difference;
+        }
+
+        if (distance < bestDistance)
+        {
+          best = j;
+          bestDistance = distance;
+        }
+      }
+
+      indices |= best << (i * 2u);
+    }
+  }
+
+  out[0u] = color0 & 0xFFu;
+  out[1u] = color0 >> 8u;
+  out[2u] = color1 & 0xFFu;
+  out[3u] = color1 >> 8u;
+
+  for (unsigned int i = 0u;
+       i < 4u;
+       i++)
+  {
+    out[4u + i] = (indices >> (i * 8u)) & 0xFFu;
+  }
+}
+
+/*
+ * Encodes the alphas of a 4x4 block into the 8 bytes BC3 puts in front of the colours: two endpoints, and a
+ * 3-bit index for each texel into the 8 alphas they're interpolated into.
+ */
+static void EncodeAlphaBlock(const uint8_t* block, uint8_t* out)
+{
+  uint8_t min = 255u;
+  uint8_t max = 0u;
+
+  for (unsigned int i = 0u;
+       i < 16u;
+       i++)
+  {
+    min = std::min(min, block[i * 4u + 3u]);
+    max = std::max(max, block[i * 4u + 3u]);
+  }
+
+  uint64_t indices = 0u;
+
+  if (max != min)
+  {
+    int palette[8u];
+    palette[0u] = max;
+    palette[1u] = min;
+
+    for (unsigned int i = 1u;
+         i < 7u;
+         i++)
+    {
+      palette[i + 1u] = ((7 - static_cast<int>(i)) * max + static_cast<int>(i) * min) / 7;
+    }
+
+    for (unsigned int i = 0u;
+         i < 16u;
+         i++)
+    {
+      uint64_t best = 0u;
+      int bestDistance = INT32_MAX;
+
+      for (unsigned int j = 0u;
+           j < 8u;
+           j++)
+      {
+        int distance = abs(static_cast<int>(block[i * 4u + 3u]) - palette[j]);
+
+        if (distance < bestDistance)
+        {
+          best = j;
+          bestDistance = distance;
+        }
+      }
+
+      indices |= best << (i * 3u);
+    }
+  }
+
+  out[0u] = max;
+  out[1u] = min;
+
+  for (unsigned int i = 0u;
+       i < 6u;
+       i++)
+  {
+    out[2u + i] = (indices >> (i * 8u)) & 0xFFu;
+  }
+}
+
+static std::vector<uint8_t> CompressLevel(const std::vector<uint8_t>& texels, unsigned int width,
+                                          unsigned int height, TextureFormatType format)
+{
+  std::vector<uint8_t> result(GetTextureLevelSize(format, width, height));
+  uint8_t* out = result.data();
+
+  for (unsigned int blockY = 0u;
+       blockY < (height + 3u) / 4u;
+       blockY++)
+  {
+    for (unsigned int blockX = 0u;
+         blockX < (width + 3u) / 4u;
+         blockX++)
+    {
+      // NOTE(Isaac): blocks that hang off the edge repeat the last row and column
+      uint8_t block[16u * 4u];
+
+      for (unsigned int i = 0u;
+           i < 16u;
+           i++)
+      {
+        unsigned int x = std::min(blockX * 4u + (i % 4u), width - 1u);
+        unsigned int y = std::min(blockY * 4u + (i / 4u), height - 1u);
+        memcpy(&(block[i * 4u]), &(texels[(y * width + x) * 4u]), 4u);
+      }
+
+      if (format == TEXTURE_FORMAT_BC3)
+      {
+        EncodeAlphaBlock(block, out);
+        out += 8u;
+      }
+
+      EncodeColorBlock(block, out);
+      out += 8u;
+    }
+  }
+
+  return result;
+}
+
+static void WriteCookedTexture(const CookedTextureHeader& header, const std::vector<CookedMip>& mips,
+                               const std::vector<std::vector<uint8_t>>& levels, const char* path)
+{
+  FILE* file = fopen(path, "wb");
+
+  if (!file)
+  {
+    fprintf(stderr, "Failed to open output file: %s\n", path);
+    exit(1);
+  }
+
+  fwrite(&header, sizeof(CookedTextureHeader), 1, file);
+  fwrite(mips.data(), sizeof(CookedMip), mips.size(), file);
+
+  for (const std::vector<uint8_t>& level : levels)
+  {
+    fwrite(level.data(), 1, level.size(), file);
+  }
+
+  if (ferror(file))
+  {
+    fprintf(stderr, "Failed to write cooked texture: %s\n", path);
+    fclose(file);
+    exit(1);
+  }
+
+  fclose(file);
+}
+
+static int CookTexture(int argc, char** argv)
+{
+  if (argc < 2)
+  {
+    fprintf(stderr, "Usage: cooker texture <input> <output> [--linear] [--compress]\n");
+    return 1;
+  }
+
+  bool isSRGB = true;     // NOTE(Isaac): things like normal maps aren't colours, and so should be `--linear`
+  bool compress = false;
+
+  for (int i = 2;
+       i < argc;
+       i++)
+  {
+    if (strcmp(argv[i], "--linear") == 0)
+    {
+      isSRGB = false;
+    }
+    else if (strcmp(argv[i], "--compress") == 0)
+    {
+      compress = true;
+    }
+    else
+    {
+      fprintf(stderr, "Unknown option: %s\n", argv[i]);
+      return 1;
+    }
+  }
+
+  int width, height, components;
+  unsigned char* pixels = stbi_load(argv[0], &width, &height, &components, 4);
+
+  if (!pixels)
+  {
+    fprintf(stderr, "Failed to load image: %s (%s)\n", argv[0], stbi_failure_reason());
+    return 1;
+  }
+
+  TextureLevel level;
+  level.width = static_cast<unsigned int>(width);
+  level.height = static_cast<unsigned int>(height);
+  level.texels.resize(level.width * level.height * 4u);
+  bool hasAlpha = false;
+
+  for (unsigned int i = 0u;
+       i < level.texels.size();
+       i++)
+  {
+    float value = pixels[i] / 255.0f;
+
+    if ((i % 4u) == 3u)
+    {
+      hasAlpha |= (pixels[i] != 255u);
+    }
+    else if (isSRGB)
+    {
+      value = SRGBToLinear(value);
+    }
+
+    level.texels[i] = value;
+  }
+
+  stbi_image_free(pixels);
+
+  // NOTE(Isaac): BC1 is half the size of BC3, so we only use BC3 if we actually need the alpha
+  TextureFormatType format = TEXTURE_FORMAT_RGBA8;
+
+  if (compress)
+  {
+    format = hasAlpha ? TEXTURE_FORMAT_BC3 : TEXTURE_FORMAT_BC1;
+  }
+
+  std::vector<CookedMip> mips;
+  std::vector<std::vector<uint8_t>> levels;
+
+  while (true)
+  {
+    std::vector<uint8_t> texels = QuantiseLevel(level, isSRGB);
+
+    if (format != TEXTURE_FORMAT_RGBA8)
+    {
+      texels = CompressLevel(texels, level.width, level.height, format);
+    }
+
+    mips.push_back(CookedMip{level.width, level.height, 0u, static_cast<uint32_t>(texels.size())});
+    levels.push_back(std::move(texels));
+
+    if (level.width == 1u && level.height == 1u)
+    {
+      break;
+    }
+
+    level = Downsample(level);
+  }
+
+  if (mips.size() > MAX_TEXTURE_MIPS)
+  {
+    fprintf(stderr, "Texture is too big (%ux%u): %s\n", width, height, argv[0]);
+    return 1;
+  }
+
+  CookedTextureHeader header;
+  header.magic      = COOKED_TEXTURE_MAGIC;
+  header.version    = COOKED_TEXTURE_VERSION;
+  header.format     = format;
+  header.flags      = isSRGB ? TEXTURE_FLAG_SRGB : 0u;
+  header.width      = static_cast<uint32_t>(width);
+  header.height     = static_cast<uint32_t>(height);
+  header.numMips    = static_cast<uint32_t>(mips.size());
+  header.mipOffset  = sizeof(CookedTextureHeader);
+
+  uint32_t offset = header.mipOffset + header.numMips * sizeof(CookedMip);
+
+  for (CookedMip& mip : mips)
+  {
+    mip.offset = offset;
+    offset += mip.size;
+  }
+
+  WriteCookedTexture(header, mips, levels, argv[1]);
+
+  static const char* FORMAT_NAMES[NUM_TEXTURE_FORMATS] = { "RGBA8", "BC1", "BC3" };
+  printf("Cooked %s -> %s (%ux%u, %u mips, %s, %u bytes)\n", argv[0], argv[1], width, height, header.numMips,
+         FORMAT_NAMES[format], offset);
+  return 0;
+}
+
+// --- Archives ---
+static bool ReadWholeFile(const char* path, std::vector<uint8_t>& contents)
+{
+  FILE* file = fopen(path, "rb");
+
+  if (!file)
+  {
+    return false;
+  }
+
+  fseek(file, 0, SEEK_END);
+  contents.resize(static_cast<size_t>(ftell(file)));
+  fseek(file, 0, SEEK_SET);
+  bool success = (fread(contents.data(), 1, contents.size(), file) == contents.size());
+  fclose(file);
+  return success;
+}
+
+struct PackedFile
+{
+  ArchiveEntry          entry;
+  std::string           path;
+  std::vector<uint8_t>  contents;   // NOTE(Isaac): as it'll be stored
+};
+
+static int CookArchive(int argc, char** argv)
+{
+  if (argc < 1)
+  {
+    fprintf(stderr, "Usage: cooker pack <output> <files...> [--compress]\n");
+    return 1;
+  }
+
+  bool compress = false;
+  std::vector<const char*> paths;
+
+  for (int i = 1;
+       i < argc;
+       i++)
+  {
+    if (strcmp(argv[i], "--compress") == 0)
+    {
+      compress = true;
+    }
+    else if (strncmp(argv[i], "--", 2u) == 0)
+    {
+      fprintf(stderr, "Unknown option: %s\n", argv[i]);
+      return 1;
+    }
+    else
+    {
+      paths.push_back(argv[i]);
+    }
+  }
+
+  std::vector<PackedFile> files(paths.size());
+  size_t originalSize = 0u;
+
+  for (unsigned int i = 0u;
+       i < paths.size();
+       i++)
+  {
+    PackedFile& file = files[i];
+    file.path = NormalisePath(paths[i]);
+
+    if (!ReadWholeFile(paths[i], file.contents))
+    {
+      fprintf(stderr, "Failed to read file: %s\n", paths[i]);
+      return 1;
+    }
+
+    file.entry.hash = HashPath(file.path);
+    file.entry.originalSize = static_cast<uint32_t>(file.contents.size());
+    file.entry.flags = 0u;
+    originalSize += file.contents.size();
+
+    /*
+     * NOTE(Isaac): decompressing isn't free, so it's only worth it if it actually saves a decent amount (things
+     * that are already compressed, like BC textures, often don't shrink much more).
+     */
+    if (compress && !file.contents.empty())
+    {
+      std::vector<uint8_t> compressed(GetMaxCompressedSize(file.contents.size()));
+      compressed.resize(CompressBlock(file.contents.data(), file.contents.size(), compressed.data()));
+
+      if (compressed.size() < file.contents.size() - file.contents.size() / 8u)
+      {
+        file.contents = std::move(compressed);
+        file.entry.flags |= ARCHIVE_ENTRY_COMPRESSED;
+      }
+    }
+
+    file.entry.size = static_cast<uint32_t>(file.contents.size());
+  }
+
+  std::sort(files.begin(), files.end(),
+    [](const PackedFile& a, const PackedFile& b)
+    {
+      return a.entry.hash < b.entry.hash;
+    });
+
+  for (unsigned int i = 1u;
+       i < files.size();
+       i++)
+  {
+    if (files[i - 1u].entry.hash == files[i].entry.hash)
+    {
+      fprintf(stderr, "Can't pack both %s and %s, because they have the same hash (or are the same file)\n",
+              files[i - 1u].path.c_str(), files[i].path.c_str());
+      return 1;
+    }
+  }
+
+  ArchiveHeader header;
+  header.magic        = ARCHIVE_MAGIC;
+  header.version      = ARCHIVE_VERSION;
+  header.numEntries   = static_cast<uint32_t>(files.size());
+  header.entryOffset  = sizeof(ArchiveHeader);
+
+  size_t offset = header.entryOffset + files.size() * sizeof(ArchiveEntry);
+
+  for (PackedFile& file : files)
+  {
+    file.entry.pathOffset = static_cast<uint32_t>(offset);
+    file.entry.pathLength = static_cast<uint32_t>(file.path.size());
+    offset += file.path.size();
+  }
+
+  for (PackedFile& file : files)
+  {
+    offset = (offset + ARCHIVE_ALIGNMENT - 1u) & ~static_cast<size_t>(ARCHIVE_ALIGNMENT - 1u);
+
+    if (offset + file.contents.size() > UINT32_MAX)
+    {
+      fprintf(stderr, "Archive is too big (it can't be more than 4GiB)\n");
+      return 1;
+    }
+
+    file.entry.offset = static_cast<uint32_t>(offset);
+    offset += file.contents.size();
+  }
+
+  FILE* output = fopen(argv[0], "wb");
+
+  if (!output)
+  {
+    fprintf(stderr, "Failed to open output file: %s\n", argv[0]);
+    return 1;
+  }
+
+  fwrite(&header, sizeof(ArchiveHeader), 1, output);
+
+  for (const PackedFile& file : files)
+  {
+    fwrite(&(file.entry), sizeof(ArchiveEntry), 1, output);
+  }
+
+  for (const PackedFile& file : files)
+  {
+    fwrite(file.path.data(), 1, file.path.size(), output);
+  }
+
+  static const uint8_t PADDING[ARCHIVE_ALIGNMENT] = {};
+
+  for (const PackedFile& file : files)
+  {
+    fwrite(PADDING, 1, file.entry.offset - ftell(output), output);
+    fwrite(file.contents.data(), 1, file.contents.size(), output);
+  }
+
+  if (ferror(output))
+  {
+    fprintf(stderr, "Failed to write archive: %s\n", argv[0]);
+    fclose(output);
+    return 1;
+  }
+
+  fclose(output);
+  printf("Packed %u files into %s (%zu bytes, from %zu)\n", header.numEntries, argv[0], offset, originalSize);
+  return 0;
+}
+
+int main(int argc, char** argv)
+{
+  if (argc < 2)
+  {
+    fprintf(stderr, "Usage: cooker <mesh|texture|pack> ...\n");
+    return 1;
+  }
+
+  if (strcmp(argv[1], "mesh") == 0)
+  {
+    return CookMesh(argc - 2, argv + 2);
+  }
+
+  if (strcmp(argv[1], "texture") == 0)
+  {
+    return CookTexture(argc - 2, argv + 2);
+  }
+
+  if (strcmp(argv[1], "pack") == 0)
+  {
+    return CookArchive(argc - 2, argv + 2);
+  }
+
+  fprintf(stderr, "Unknown asset type: %s\n", argv[1]);
+  return 1;
+}
@@ -0,0 +1,274 @@
+/*
+ * Copyright (C) 2017, Isaac Woods.
+ * See LICENCE.md
+ */
+
+/*
+ * Checks the parts of the entity system that the game doesn't exercise yet, and times component lookups against
+ * how entities used to store their components. Exits with 1 if any of the checks fail, so it can be run by
+ * `make check`.
+ */
+
+#include <entity.hpp>
+#include <cstdio>
+#include <cmath>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <algorithm>
+#include <typeindex>
+#include <typeinfo>
+#include <unordered_map>
+
+// --- Checks ---
+static bool MatricesMatch(const Mat<4u>& a, const Mat<4u>& b)
+{
+  const float EPSILON = 0.0001f;
+
+  for (unsigned int i = 0u;
+       i < 4u;
+       i++)
+  {
+    for (unsigned int j = 0u;
+         j < 4u;
+         j++)
+    {
+      if (fabsf(a[i][j] - b[i][j]) > EPSILON)
+      {
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+/*
+ * Builds a small hierarchy of parents and children, moves them around, and checks `UpdateWorldTransforms` keeps
+ * up. Returns what went wrong, or null if nothing did.
+ */
+static const char* CheckTransformHierarchy()
+{
+  EntityManager entities;
+  Transform transform;
+  transform.scale = 2.0f;
+
+  transform.position = Vec<3u>(1.0f, 2.0f, 0.0f);
+  Entity root = entities.Create(transform, LocalToWorld());
+  const Mat<4u> rootLocal = CreateTransformation(transform);
+
+  // NOTE(Isaac): the grandchild is made first, so children aren't stored after their parents
+  transform.position = Vec<3u>(0.0f, 1.0f, 0.0f);
+  Entity grandchild = entities.Create(transform, LocalToWorld());
+  const Mat<4u> grandchildLocal = CreateTransformation(transform);
+
+  transform.position = Vec<3u>(3.0f, 0.0f, 0.0f);
+  Entity child = entities.Create(transform, LocalToWorld());
+  const Mat<4u> childLocal = CreateTransformation(transform);
+
+  entities.AddComponent(grandchild, Parent(child));
+  entities.AddComponent(child, Parent(root));
+
+  if (!UpdateWorldTransforms(entities))
+  {
+    return "new entities weren't updated";
+  }
+
+  if (!MatricesMatch(entities.GetComponent<LocalToWorld>(grandchild)->matrix, rootLocal * childLocal * grandchildLocal))
+  {
+    return "grandchild wasn't relative to its parents";
+  }
+
+  if (UpdateWorldTransforms(entities))
+  {
+    return "nothing moved, but something was updated";
+  }
+
+  // Moving the root has to move everything below it
+  transform.position = Vec<3u>(5.0f, 5.0f, 0.0f);
+  entities.AddComponent(root, transform);
+  const Mat<4u> movedLocal = CreateTransformation(transform);
+
+  if (!UpdateWorldTransforms(entities) ||
+      !MatricesMatch(entities.GetComponent<LocalToWorld>(grandchild)->matrix, movedLocal * childLocal * grandchildLocal))
+  {
+    return "grandchild didn't follow its moved root";
+  }
+
+  // Once its parent's gone, a child's transform is relative to the world
+  entities.Destroy(child);
+  transform.position = Vec<3u>(0.0f, 7.0f, 0.0f);
+  *(entities.GetComponent<Transform>(grandchild)) = transform;
+  entities.MarkChanged<Transform>(grandchild);
+
+  if (!UpdateWorldTransforms(entities) ||
+      !MatricesMatch(entities.GetComponent<LocalToWorld>(grandchild)->matrix, CreateTransformation(transform)))
+  {
+    return "orphan wasn't relative to the world";
+  }
+
+  return nullptr;
+}
+
+// --- Benchmark ---
+/*
+ * Times looking up a component on each of `numEntities` entities, in a random order. It does the same with a map
+ * from `typeid`s to virtual components and a `dynamic_cast` (which is how entities used to work), to compare
+ * against. All of the times are per entity, in nanoseconds.
+ */
+struct ComponentBenchmark
+{
+  float mapLookupTime;
+  float lookupTime;
+  float hasComponentTime;
+  float iterationTime;    // NOTE(Isaac): with `ForEach`, rather than looking each one up
+};
+
+/*
+ * How entities used to store their components, so we've got something to compare against.
+ */
+struct MapComponent
+{
+  virtual ~MapComponent() { }
+};
+
+struct MapPosition : MapComponent
+{
+  Vec<3u> position;
+};
+
+struct MapVelocity : MapComponent
+{
+  Vec<3u> velocity;
+};
+
+struct MapEntity
+{
+  ~MapEntity()
+  {
+    for (auto& mapping : componentMap)
+    {
+      delete mapping.second;
+    }
+  }
+
+  template<typename T>
+  T* GetComponent()
+  {
+    return dynamic_cast<T*>(componentMap[typeid(T)]);
+  }
+
+  std::unordered_map<std::type_index, MapComponent*> componentMap;
+};
+
+struct BenchmarkPosition
+{
+  Vec<3u> position;
+};
+
+struct BenchmarkVelocity
+{
+  Vec<3u> velocity;
+};
+
+template<typename F>
+static float TimePerItem(unsigned int numItems, F function)
+{
+  auto start = std::chrono::high_resolution_clock::now();
+  function();
+  auto end = std::chrono::high_resolution_clock::now();
+  return std::chrono::duration<float, std::nano>(end - start).count() / static_cast<float>(numItems);
+}
+
+static ComponentBenchmark BenchmarkComponentLookups(unsigned int numEntities)
+{
+  EntityManager entities;
+  std::vector<MapEntity> mapEntities(numEntities);
+  std::vector<Entity> order;
+
+  // NOTE(Isaac): half of the entities have velocities too, so there's more than one archetype to look in
+  for (unsigned int i = 0u;
+       i < numEntities;
+       i++)
+  {
+    Vec<3u> position(static_cast<float>(i), 0.0f, 0.0f);
+    MapPosition* mapPosition = new MapPosition;
+    mapPosition->position = position;
+    mapEntities[i].componentMap[typeid(MapPosition)] = mapPosition;
+
+    if (i % 2u)
+    {
+      mapEntities[i].componentMap[typeid(MapVelocity)] = new MapVelocity;
+      order.push_back(entities.Create(BenchmarkPosition{position}, BenchmarkVelocity{Vec<3u>()}));
+    }
+    else
+    {
+      order.push_back(entities.Create(BenchmarkPosition{position}));
+    }
+  }
+
+  // Look them up in a random order, so it's not just measuring how well the prefetcher does
+  std::mt19937 generator(1234u);
+  std::shuffle(order.begin(), order.end(), generator);
+
+  ComponentBenchmark result;
+  float sum = 0.0f;
+
+  result.mapLookupTime = TimePerItem(numEntities, [&]()
+    {
+      for (Entity entity : order)
+      {
+        sum += mapEntities[GetEntityIndex(entity)].GetComponent<MapPosition>()->position.x();
+      }
+    });
+
+  result.lookupTime = TimePerItem(numEntities, [&]()
+    {
+      for (Entity entity : order)
+      {
+        sum += entities.GetComponent<BenchmarkPosition>(entity)->position.x();
+      }
+    });
+
+  unsigned int numMoving = 0u;
+  result.hasComponentTime = TimePerItem(numEntities, [&]()
+    {
+      for (Entity entity : order)
+      {
+        numMoving += entities.HasComponent<BenchmarkVelocity>(entity) ? 1u : 0u;
+      }
+    });
+
+  result.iterationTime = TimePerItem(numEntities, [&]()
+    {
+      entities.ForEach<const BenchmarkPosition>(
+        [&](Entity /*entity*/, const BenchmarkPosition& position)
+        {
+          sum += position.position.x();
+        });
+    });
+
+  // NOTE(Isaac): stops the compiler throwing the lookups away
+  volatile float sink = sum + static_cast<float>(numMoving);
+  (void)sink;
+  return result;
+}
+
+int main()
+{
+  const char* hierarchyError = CheckTransformHierarchy();
+
+  if (hierarchyError)
+  {
+    fprintf(stderr, "FAILED: transform hierarchy: %s\n", hierarchyError);
+    return 1;
+  }
+
+  printf("Transform hierarchy: OK\n");
+
+  ComponentBenchmark benchmark = BenchmarkComponentLookups(100000u);
+  printf("Per lookup: %.1f ns (map: %.1f ns)\n", benchmark.lookupTime, benchmark.mapLookupTime);
+  printf("Per HasComponent: %.1f ns, per entity iterated: %.1f ns\n", benchmark.hasComponentTime,
+         benchmark.iterationTime);
+  return 0;
+}
@@ -0,0 +1,421 @@
+/*
+ * Copyright (C) 2017, Isaac Woods.
+ * See LICENCE.md
+ */
+
+#include <optimise.hpp>
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+
+float CalculateACMR(const unsigned int* indices, unsigned int numIndices, unsigned int numVertices,
+                    unsigned int cacheSize)
+{
+  if (numIndices == 0u)
+  {
+    return 0.0f;
+  }
+
+  /*
+   * Rather than actually shuffling a FIFO around, we remember when each vertex was last put in the cache. It's
+   * still in there if fewer than `cacheSize` other vertices have been put in since.
+   */
+  std::vector<unsigned int> insertedAt(numVertices, 0u);
+  unsigned int time = cacheSize + 1u;
+  unsigned int misses = 0u;
+
+  for (unsigned int i = 0u;
+       i < numIndices;
+       i++)
+  {
+    unsigned int vertex = indices[i];
+
+    if (time - insertedAt[vertex] > cacheSize)
+    {
+      insertedAt[vertex] = time++;
+      misses++;
+    }
+  }
+
+  return static_cast<float>(misses) / static_cast<float>(numIndices / 3u);
+}
+
+// --- Vertex cache ---
+/*
+ * These are the constants from Forsyth's paper. The cache we simulate while scoring is bigger than the one
+ * we're really targeting, which gives better results across GPUs with different cache sizes.
+ */
+#define SCORE_CACHE_SIZE      32u
+#define CACHE_DECAY_POWER     1.5f
+#define LAST_TRIANGLE_SCORE   0.75f
+#define VALENCE_BOOST_SCALE   2.0f
+#define VALENCE_BOOST_POWER   0.5f
+
+static float ScoreVertex(int cachePosition, unsigned int remainingTriangles)
+{
+  if (remainingTriangles == 0u)
+  {
+    // NOTE(Isaac): nothing left uses this vertex, so it shouldn't make any triangle more attractive
+    return -1.0f;
+  }
+
+  float score = 0.0f;
+
+  if (cachePosition >= 0)
+  {
+    if (cachePosition < 3)
+    {
+      /*
+       * The vertices of the triangle we've just added get a fixed score, so we don't just keep picking
+       * triangles off the same strip.
+       */
+      score = LAST_TRIANGLE_SCORE;
+    }
+    else
+    {
+      const float scale = 1.0f / static_cast<float>(SCORE_CACHE_SIZE - 3u);
+      score = powf(1.0f - static_cast<float>(cachePosition - 3) * scale, CACHE_DECAY_POWER);
+    }
+  }
+
+  // Vertices that are only used by a few more triangles are boosted, so we finish them off and stop needing them
+  score += VALENCE_BOOST_SCALE * powf(static_cast<float>(remainingTriangles), -VALENCE_BOOST_POWER);
+  return score;
+}
+
+void OptimiseVertexCache(unsigned int* indices, unsigned int numIndices, unsigned int numVertices)
+{
+  const unsigned int numTriangles = numIndices / 3u;
+
+  if (numTriangles == 0u)
+  {
+    return;
+  }
+
+  // Build a list of the triangles that use each vertex
+  std::vector<unsigned int> remaining(numVertices, 0u);   // NOTE(Isaac): triangles not yet added, per vertex
+
+  for (unsigned int i = 0u;
+       i < numIndices;
+       i++)
+  {
+    remaining[indices[i]]++;
+  }
+
+  std::vector<unsigned int> firstTriangle(numVertices + 1u, 0u);
+
+  for (unsigned int i = 0u;
+       i < numVertices;
+       i++)
+  {
+    firstTriangle[i + 1u] = firstTriangle[i] + remaining[i];
+  }
+
+  std::vector<unsigned int> vertexTriangles(numIndices);
+  std::vector<unsigned int> fill(firstTriangle.begin(), firstTriangle.end() - 1);
+
+  for (unsigned int i = 0u;
+       i < numIndices;
+       i++)
+  {
+    vertexTriangles[fill[indices[i]]++] = i / 3u;
+  }
+
+  std::vector<int> cachePosition(numVertices, -1);
+  std::vector<float> vertexScore(numVertices);
+
+  for (unsigned int i = 0u;
+       i < numVertices;
+       i++)
+  {
+    vertexScore[i] = ScoreVertex(-1, remaining[i]);
+  }
+
+  std::vector<float> triangleScore(numTriangles);
+  std::vector<bool> added(numTriangles, false);
+
+  for (unsigned int i = 0u;
+       i < numTriangles;
+       i++)
+  {
+    triangleScore[i] = vertexScore[indices[i*3u+0u]] + vertexScore[indices[i*3u+1u]] + vertexScore[indices[i*3u+2u]];
+  }
+
+  std::vector<unsigned int> output;
+  output.reserve(numIndices);
+
+  // NOTE(Isaac): three extra slots, for the vertices pushed out of the cache by the triangle being added
+  unsigned int cache[SCORE_CACHE_SIZE + 3u];
+  unsigned int cacheCount = 0u;
+  unsigned int scanCursor = 0u;
+
+  int bestTriangle = -1;
+  float bestScore = -1.0f;
+
+  for (unsigned int i = 0u;
+       i < numTriangles;
+       i++)
+  {
+    if (triangleScore[i] > bestScore)
+    {
+      bestScore = triangleScore[i];
+      bestTriangle = static_cast<int>(i);
+    }
+  }
+
+  while (bestTriangle >= 0)
+  {
+    unsigned int triangle = static_cast<unsigned int>(bestTriangle);
+    added[triangle] = true;
+
+    unsigned int newCache[SCORE_CACHE_SIZE + 3u];
+    unsigned int newCount = 0u;
+
+    // The new triangle's vertices go at the front of the cache, then everything that was already there
+    for (unsigned int j = 0u;
+         j < 3u;
+         j++)
+    {
+      unsigned int vertex = indices[triangle*3u+j];
+      output.push_back(vertex);
+      newCache[newCount++] = vertex;
+      remaining[vertex]--;
+
+      // Remove this triangle from the vertex's list, so we don't keep looking at it
+      unsigned int* begin = &vertexTriangles[firstTriangle[vertex]];
+      unsigned int* end = begin + remaining[vertex] + 1u;
+      *std::find(begin, end, triangle) = *(end - 1u);
+    }
+
+    for (unsigned int j = 0u;
+         j < cacheCount;
+         j++)
+    {
+      unsigned int vertex = cache[j];
+
+      if (vertex != newCache[0u] && vertex != newCache[1u] && vertex != newCache[2u])
+      {
+        newCache[newCount++] = vertex;
+      }
+    }
+
+    // Anything that's fallen off the end of the cache needs rescoring too
+    for (unsigned int j = 0u;
+         j < newCount;
+         j++)
+    {
+      unsigned int vertex = newCache[j];
+      cachePosition[vertex] = (j < SCORE_CACHE_SIZE) ? static_cast<int>(j) : -1;
+      vertexScore[vertex] = ScoreVertex(cachePosition[vertex], remaining[vertex]);
+    }
+
+    cacheCount = std::min(newCount, SCORE_CACHE_SIZE);
+    memcpy(cache, newCache, cacheCount * sizeof(unsigned int));
+
+    /*
+     * Only triangles that use a vertex in the cache can have changed score, so the next triangle is almost
+     * always one of those.
+     */
+    bestTriangle = -1;
+    bestScore = -1.0f;
+
+    for (unsigned int j = 0u;
+         j < newCount;
+         j++)
+    {
+      unsigned int vertex = newCache[j];
+
+      for (unsigned int k = 0u;
+           k < remaining[vertex];
+           k++)
+      {
+        unsigned int other = vertexTriangles[firstTriangle[vertex] + k];
+        float score = vertexScore[indices[other*3u+0u]] +
+                      vertexScore[indices[other*3u+1u]] +
+                      vertexScore[indices[other*3u+2u]];
+        triangleScore[other] = score;
+
+        if (score > bestScore)
+        {
+          bestScore = score;
+          bestTriangle = static_cast<int>(other);
+        }
+      }
+    }
+
+    // If none of them are usable, fall back to the next triangle we haven't added yet
+    if (bestTriangle < 0)
+    {
+      while (scanCursor < numTriangles && added[scanCursor])
+      {
+        scanCursor++;
+      }
+
+      if (scanCursor < numTriangles)
+      {
+        bestTriangle = static_cast<int>(scanCursor);
+      }
+    }
+  }
+
+  memcpy(indices, output.data(), numIndices * sizeof(unsigned int));
+}
+
+// --- Overdraw ---
+struct TriangleCluster
+{
+  unsigned int  first;      // NOTE(Isaac): in triangles
+  unsigned int  count;
+  float         sortKey;
+};
+
+void OptimiseOverdraw(unsigned int* indices, unsigned int numIndices, const Vertex* vertices,
+                      unsigned int numVertices, float threshold)
+{
+  const unsigned int numTriangles = numIndices / 3u;
+
+  if (numTriangles == 0u)
+  {
+    return;
+  }
+
+  const float originalACMR = CalculateACMR(indices, numIndices, numVertices);
+
+  /*
+   * Split the triangles into clusters wherever the cache has effectively started again (a triangle where all
+   * three vertices miss). Reordering whole clusters keeps most of the reuse inside each one.
+   */
+  std::vector<TriangleCluster> clusters;
+  std::vector<unsigned int> insertedAt(numVertices, 0u);
+  unsigned int time = DEFAULT_VERTEX_CACHE_SIZE + 1u;
+
+  for (unsigned int i = 0u;
+       i < numTriangles;
+       i++)
+  {
+    unsigned int misses = 0u;
+
+    for (unsigned int j = 0u;
+         j < 3u;
+         j++)
+    {
+      unsigned int vertex = indices[i*3u+j];
+
+      if (time - insertedAt[vertex] > DEFAULT_VERTEX_CACHE_SIZE)
+      {
+        insertedAt[vertex] = time++;
+        misses++;
+      }
+    }
+
+    if (clusters.empty() || misses == 3u)
+    {
+      clusters.push_back(TriangleCluster{i, 0u, 0.0f});
+    }
+
+    clusters.back().count++;
+  }
+
+  // Find the middle of the mesh, weighted by area so dense patches don't drag it towards them
+  Vec<3u> meshCentroid;
+  float meshArea = 0.0f;
+
+  for (unsigned int i = 0u;
+       i < numTriangles;
+       i++)
+  {
+    const Vec<3u>& a = vertices[indices[i*3u+0u]].position;
+    const Vec<3u>& b = vertices[indices[i*3u+1u]].position;
+    const Vec<3u>& c = vertices[indices[i*3u+2u]].position;
+    float area = Length(Cross(b - a, c - a));
+
+    meshCentroid += (a + b + c) * (area / 3.0f);
+    meshArea += area;
+  }
+
+  if (meshArea > 0.0f)
+  {
+    meshCentroid *= 1.0f / meshArea;
+  }
+
+  /*
+   * Each cluster is keyed on how far it faces out from the middle of the mesh: the further out it faces, the
+   * more likely it is to be in front of other clusters, so we want to draw it first.
+   */
+  for (TriangleCluster& cluster : clusters)
+  {
+    Vec<3u> centroid;
+    Vec<3u> normal;
+    float area = 0.0f;
+
+    for (unsigned int i = cluster.first;
+         i < cluster.first + cluster.count;
+         i++)
+    {
+      const Vec<3u>& a = vertices[indices[i*3u+0u]].position;
+      const Vec<3u>& b = vertices[indices[i*3u+1u]].position;
+      const Vec<3u>& c = vertices[indices[i*3u+2u]].position;
+      Vec<3u> cross = Cross(b - a, c - a);
+      float triangleArea = Length(cross);
+
+      centroid += (a + b + c) * (triangleArea / 3.0f);
+      normal += cross;
+      area += triangleArea;
+    }
+
+    if (area > 0.0f)
+    {
+      centroid *= 1.0f / area;
+    }
+
+    float normalLength = Length(normal);
+    cluster.sortKey = (normalLength > 0.0f) ? Dot(centroid - meshCentroid, normal * (1.0f / normalLength)) : 0.0f;
+  }
+
+  std::stable_sort(clusters.begin(), clusters.end(), [](const TriangleCluster& a, const TriangleCluster& b)
+                                                     {
+                                                       return a.sortKey > b.sortKey;
+                                                     });
+
+  std::vector<unsigned int> reordered;
+  reordered.reserve(numIndices);
+
+  for (const TriangleCluster& cluster : clusters)
+  {
+    reordered.insert(reordered.end(), indices + cluster.first * 3u, indices + (cluster.first + cluster.count) * 3u);
+  }
+
+  if (CalculateACMR(reordered.data(), numIndices, numVertices) <= originalACMR * threshold)
+  {
+    memcpy(indices, reordered.data(), numIndices * sizeof(unsigned int));
+  }
+}
+
+// --- Vertex fetch ---
+unsigned int OptimiseVertexFetch(Vertex* vertices, unsigned int numVertices, unsigned int* indices,
+                                 unsigned int numIndices)
+{
+  static const unsigned int UNUSED = ~0u;
+  std::vector<unsigned int> remap(numVertices, UNUSED);
+  std::vector<Vertex> reordered;
+  reordered.reserve(numVertices);
+
+  for (unsigned int i = 0u;
+       i < numIndices;
+       i++)
+  {
+    unsigned int& newIndex = remap[indices[i]];
+
+    if (newIndex == UNUSED)
+    {
+      newIndex = static_cast<unsigned int>(reordered.size());
+      reordered.push_back(vertices[indices[i]]);
+    }
+
+    indices[i] = newIndex;
+  }
+
+  std::copy(reordered.begin(), reordered.end(), vertices);
+  return static_cast<unsigned int>(reordered.size());
+}
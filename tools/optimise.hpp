@@ -0,0 +1,41 @@
+/*
+ * Copyright (C) 2017, Isaac Woods.
+ * See LICENCE.md
+ */
+
+#pragma once
+
+#include <maths.hpp>
+
+/*
+ * The GPU keeps the results of the vertex shader for the last few vertices it's transformed, so if a triangle
+ * reuses a vertex that's still in there, it doesn't have to be transformed again. ACMR (average cache miss
+ * ratio) is the number of vertices we have to transform per triangle, with a FIFO cache of the given size.
+ * 0.5 is the best a regular grid can do, and 3.0 is the worst possible.
+ */
+#define DEFAULT_VERTEX_CACHE_SIZE 16u
+
+float CalculateACMR(const unsigned int* indices, unsigned int numIndices, unsigned int numVertices,
+                    unsigned int cacheSize=DEFAULT_VERTEX_CACHE_SIZE);
+
+/*
+ * Reorders triangles so that they reuse vertices that were transformed recently (using Tom Forsyth's "Linear-
+ * Speed Vertex Cache Optimisation").
+ */
+void OptimiseVertexCache(unsigned int* indices, unsigned int numIndices, unsigned int numVertices);
+
+/*
+ * Reorders clusters of triangles so that the ones facing out from the middle of the mesh are drawn first, so
+ * the ones behind them are more likely to fail the depth test before they're shaded. This fights with the
+ * vertex cache, so the new order is only kept if the ACMR doesn't get worse by more than `threshold` (e.g.
+ * 1.05 allows it to get 5% worse). Should be done after `OptimiseVertexCache`.
+ */
+void OptimiseOverdraw(unsigned int* indices, unsigned int numIndices, const Vertex* vertices,
+                      unsigned int numVertices, float threshold);
+
+/*
+ * Reorders vertices into the order they're first used by the indices, so fetching them walks through memory
+ * in order. Vertices that aren't used at all are dropped. Returns the new number of vertices.
+ */
+unsigned int OptimiseVertexFetch(Vertex* vertices, unsigned int numVertices, unsigned int* indices,
+                                 unsigned int numIndices);